@@ -0,0 +1,110 @@
+// import_bench.cpp - import of a large host directory tree
+//
+// Creates a host tree of 'files' empty files (10 directories of 100
+// subdirectories, the files spread evenly over the subdirectories) unless
+// the host directory already exists, then imports it into an empty
+// navigator with -j 1, 2, 4, 8 and 16 and reports entries per second for
+// each. Every number is the best of three imports into a fresh tree; the
+// first, untimed import warms the host's directory cache.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o import_bench bench/import_bench.cpp
+// Usage: ./import_bench <host-directory> [files]
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <fcntl.h>
+#include <iomanip>
+#include <unistd.h>
+
+namespace {
+
+// Swallows command output so that only the commands themselves are timed
+struct NullBuffer : std::streambuf {
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+template <typename F>
+double millis(F run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool createHostTree(const std::string& host, size_t files) {
+    size_t perDirectory = (files + 999) / 1000;
+    size_t made = 0;
+    for (int i = 0; i < 10; ++i) {
+        for (int j = 0; j < 100; ++j) {
+            std::string directory = host + "/a" + std::to_string(i) + "/b" + std::to_string(j);
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+            if (error) {
+                return false;
+            }
+            for (size_t k = 0; k < perDirectory && made < files; ++k, ++made) {
+                std::string file = directory + "/file_" + std::to_string(k) + ".txt";
+                int descriptor = open(file.c_str(), O_CREAT | O_WRONLY, 0644);
+                if (descriptor < 0) {
+                    return false;
+                }
+                close(descriptor);
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cout << "Usage: " << argv[0] << " <host-directory> [files]" << '\n';
+        return 1;
+    }
+    std::string host = argv[1];
+    size_t files = argc == 3 ? std::stoul(argv[2]) : 1000000;
+    std::cout << std::fixed << std::setprecision(1);
+    if (!std::filesystem::exists(host)) {
+        double created = millis([&] {
+            if (!createHostTree(host, files)) {
+                files = 0;
+            }
+        });
+        if (files == 0) {
+            std::cout << "Error: Cannot create the host tree in '" << host << "'." << '\n';
+            return 1;
+        }
+        std::cout << "Created " << files << " files in '" << host << "' in " << created << " ms" << '\n';
+    }
+
+    NullBuffer discard;
+    std::ostream discarded(&discard);
+    size_t entries = 0;
+    {
+        FileSystem fs;
+        std::ostringstream out;
+        Session session(out);
+        fs.import(session, host, "", 0);
+        std::string report = out.str();
+        if (report.rfind("Imported ", 0) != 0) {
+            std::cout << report;
+            return 1;
+        }
+        entries = std::stoul(report.substr(9));
+    }
+    for (size_t threads : {1, 2, 4, 8, 16}) {
+        double best = 0;
+        for (int run = 0; run < 3; ++run) {
+            FileSystem fs;
+            Session session(discarded);
+            double time = millis([&] { fs.import(session, host, "", threads); });
+            best = run == 0 ? time : std::min(best, time);
+        }
+        std::cout << "import -j " << threads << ": " << entries << " entries in " << best << " ms, "
+                  << static_cast<long>(entries * 1000 / best) << " entries/s" << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+// mixed_bench.cpp - many sessions looking up and creating nodes at once
+//
+// Builds 256 directories of 16 subdirectories each, then has 'threads'
+// threads, each with its own Session on the one FileSystem, run a mix of
+// 95% lookups (cd by absolute path into a random subdirectory) and 5%
+// creates (touch or mkdir of a new name in the directory just entered).
+// The same number of operations is run with 1 thread and with 'threads'
+// threads, and the operations per second are reported for both.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o mixed_bench bench/mixed_bench.cpp
+// Usage: ./mixed_bench [operations] [-j threads]
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <iomanip>
+#include <random>
+
+namespace {
+
+// Swallows command output so that only the commands themselves are timed
+struct NullBuffer : std::streambuf {
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+NullBuffer discard;
+std::ostream discarded(&discard);
+
+// Runs 'operations' operations spread over 'threads' threads and returns
+// the seconds taken
+double run(FileSystem& fs, const std::vector<std::string>& paths, size_t operations, size_t threads) {
+    std::atomic<bool> go{false};
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            Session session(discarded);
+            std::mt19937 rng(static_cast<unsigned>(t * 7919 + threads));
+            std::string prefix = "n" + std::to_string(threads) + "_" + std::to_string(t) + "_";
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < operations / threads; ++i) {
+                fs.cd(session, paths[rng() % paths.size()]);
+                if (rng() % 100 < 5) {
+                    if (i % 2 == 0) {
+                        fs.touch(session, prefix + std::to_string(i));
+                    } else {
+                        fs.mkdir(session, prefix + std::to_string(i));
+                    }
+                }
+            }
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t operations = 2000000;
+    size_t threads = 16;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "-j" && i + 1 < argc) {
+            threads = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (std::isdigit(static_cast<unsigned char>(option[0]))) {
+            operations = std::stoul(option);
+        } else {
+            std::cout << "Usage: " << argv[0] << " [operations] [-j threads]" << '\n';
+            return 1;
+        }
+    }
+
+    FileSystem fs;
+    Session setup(discarded);
+    std::vector<std::string> paths;
+    for (int i = 0; i < 256; ++i) {
+        std::string directory = "d" + std::to_string(i);
+        fs.cd(setup, "/");
+        fs.mkdir(setup, directory);
+        fs.cd(setup, directory);
+        for (int j = 0; j < 16; ++j) {
+            std::string subdirectory = "s" + std::to_string(j);
+            fs.mkdir(setup, subdirectory);
+            paths.push_back("/" + directory + "/" + subdirectory);
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::vector<size_t> threadCounts{1};
+    if (threads != 1) {
+        threadCounts.push_back(threads);
+    }
+    for (size_t count : threadCounts) {
+        double seconds = run(fs, paths, operations, count);
+        size_t done = operations / count * count;
+        std::cout << count << (count == 1 ? " thread: " : " threads: ") << done << " operations (95% cd, 5% create) in "
+                  << seconds * 1000 << " ms, " << static_cast<long>(done / seconds) << " operations/s" << '\n';
+    }
+    Session report(std::cout);
+    fs.stats(report);
+    return 0;
+}
@@ -0,0 +1,246 @@
+// path_bench.cpp - path lookups and listings on trees of chosen shapes
+//
+// entries: one directory holding 10, 1000 and 1000000 subdirectories. Times
+//          cd into a random one of them and back out with cd .., and ls of
+//          the whole directory.
+// resolve: cd from the root to the bottom of a chain of 1000 nested
+//          directories, per path component; cd by absolute path into a
+//          random one of 1000000 subdirectories; and touch in that
+//          directory, with names already taken and with new names.
+// components: cd on paths of 50 components through a chain of 50 nested
+//          directories: absolute, relative with '.' and repeated slashes,
+//          and 50 times '..'.
+// paths:   pwd at the bottom of a chain of 10000 nested directories, also
+//          after moving up and down again, and find with 1000000 hits
+//          (1000 directories of 1000 subdirectories, each holding a file
+//          named 'hit').
+//
+// Every number is the best of five runs.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o path_bench bench/path_bench.cpp
+// Usage: ./path_bench [entries] [resolve] [components] [paths]
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <iomanip>
+#include <random>
+
+namespace {
+
+// Swallows command output so that only the commands themselves are timed
+struct NullBuffer : std::streambuf {
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+NullBuffer discard;
+std::ostream discarded(&discard);
+
+template <typename F>
+double millis(F run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename F>
+double bestOf(int runs, F run) {
+    double best = millis(run);
+    for (int i = 1; i < runs; ++i) {
+        best = std::min(best, millis(run));
+    }
+    return best;
+}
+
+void benchEntries() {
+    for (size_t count : {size_t(10), size_t(1000), size_t(1000000)}) {
+        FileSystem fs;
+        Session session(discarded);
+        fs.mkdir(session, "d");
+        fs.cd(session, "d");
+        for (size_t i = 0; i < count; ++i) {
+            fs.mkdir(session, "entry_" + std::to_string(i));
+        }
+        std::mt19937 rng(1);
+        std::vector<std::string> names;
+        for (int i = 0; i < 100000; ++i) {
+            names.push_back("entry_" + std::to_string(rng() % count));
+        }
+        double lookup = bestOf(5, [&] {
+            for (const auto& name : names) {
+                fs.cd(session, name);
+                fs.cd(session, "..");
+            }
+        }) * 1e6 / names.size();
+        size_t listings = std::max<size_t>(1, 1000000 / count);
+        double listing = bestOf(5, [&] {
+            for (size_t i = 0; i < listings; ++i) {
+                fs.ls(session);
+            }
+        }) * 1e6 / (listings * count);
+        std::cout << count << " entries: cd <entry> + cd .. " << lookup << " ns, ls " << listing << " ns/entry"
+                  << '\n';
+    }
+}
+
+void benchResolve() {
+    {
+        FileSystem fs;
+        Session session(discarded);
+        std::string path;
+        for (int i = 0; i < 1000; ++i) {
+            fs.mkdir(session, "d");
+            fs.cd(session, "d");
+            path += "/d";
+        }
+        double deep = bestOf(5, [&] {
+            for (int i = 0; i < 1000; ++i) {
+                fs.cd(session, path);
+            }
+        }) * 1e6 / (1000 * 1000);
+        std::cout << "depth 1000: cd " << deep << " ns/component" << '\n';
+    }
+    FileSystem fs;
+    Session session(discarded);
+    fs.mkdir(session, "w");
+    fs.cd(session, "w");
+    size_t count = 1000000;
+    for (size_t i = 0; i < count; ++i) {
+        fs.mkdir(session, "entry_" + std::to_string(i));
+    }
+    std::mt19937 rng(2);
+    std::vector<std::string> names, paths;
+    for (int i = 0; i < 100000; ++i) {
+        names.push_back("entry_" + std::to_string(rng() % count));
+        paths.push_back("/w/" + names.back());
+    }
+    double wide = bestOf(5, [&] {
+        for (const auto& path : paths) {
+            fs.cd(session, path);
+        }
+    }) * 1e6 / paths.size();
+    fs.cd(session, "/w");
+    double taken = bestOf(5, [&] {
+        for (const auto& name : names) {
+            fs.touch(session, name);
+        }
+    }) * 1e6 / names.size();
+    for (auto& name : names) {
+        name.replace(0, 5, "fresh");
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    double created = millis([&] {
+        for (const auto& name : names) {
+            fs.touch(session, name);
+        }
+    }) * 1e6 / names.size();
+    std::cout << "1000000 entries: cd /w/<entry> " << wide << " ns, touch of a taken name " << taken
+              << " ns, touch of a new name " << created << " ns" << '\n';
+}
+
+void benchComponents() {
+    FileSystem fs;
+    Session session(discarded);
+    std::string absolute, relative = ".", up;
+    for (int i = 0; i < 50; ++i) {
+        std::string name = "component_" + std::to_string(i);
+        fs.mkdir(session, name);
+        fs.cd(session, name);
+        absolute += "/" + name;
+        relative += (i % 2 == 0 ? "/./" : "//") + name;
+        up += i == 0 ? ".." : "/..";
+    }
+    const int runs = 100000;
+    double plain = bestOf(5, [&] {
+        for (int i = 0; i < runs; ++i) {
+            fs.cd(session, absolute);
+        }
+    }) * 1e6 / runs;
+    double dotted = bestOf(5, [&] {
+        for (int i = 0; i < runs; ++i) {
+            fs.cd(session, "/");
+            fs.cd(session, relative);
+        }
+    }) * 1e6 / runs;
+    double parents = bestOf(5, [&] {
+        for (int i = 0; i < runs; ++i) {
+            fs.cd(session, absolute);
+            fs.cd(session, up);
+        }
+    }) * 1e6 / runs;
+    std::cout << "50 components: cd absolute " << plain << " ns, cd / + cd relative with . and // " << dotted
+              << " ns, cd absolute + cd 50 x .. " << parents << " ns" << '\n';
+}
+
+void benchPaths() {
+    {
+        FileSystem fs;
+        Session session(discarded);
+        for (int i = 0; i < 10000; ++i) {
+            fs.mkdir(session, "d");
+            fs.cd(session, "d");
+        }
+        const int runs = 1000;
+        double pwd = bestOf(5, [&] {
+            for (int i = 0; i < runs; ++i) {
+                fs.pwd(session);
+            }
+        }) * 1e6 / runs;
+        double moved = bestOf(5, [&] {
+            for (int i = 0; i < runs; ++i) {
+                fs.cd(session, "..");
+                fs.cd(session, "d");
+                fs.pwd(session);
+            }
+        }) * 1e6 / runs;
+        std::cout << "depth 10000: pwd " << pwd << " ns, cd .. + cd d + pwd " << moved << " ns" << '\n';
+    }
+    FileSystem fs;
+    Session session(discarded);
+    for (int i = 0; i < 1000; ++i) {
+        std::string directory = "dir_" + std::to_string(i);
+        fs.mkdir(session, directory);
+        fs.cd(session, directory);
+        for (int j = 0; j < 1000; ++j) {
+            std::string subdirectory = "sub_" + std::to_string(j);
+            fs.mkdir(session, subdirectory);
+            fs.cd(session, subdirectory);
+            fs.touch(session, "hit");
+            fs.cd(session, "..");
+        }
+        fs.cd(session, "/");
+    }
+    double find = bestOf(3, [&] { fs.find(session, "hit"); });
+    std::cout << "1000000 hits: find " << find << " ms, " << static_cast<long>(1e9 / find) << " paths/s" << '\n';
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> modes;
+    for (int i = 1; i < argc; ++i) {
+        modes.push_back(argv[i]);
+    }
+    if (modes.empty()) {
+        modes = {"entries", "resolve", "components", "paths"};
+    }
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto& mode : modes) {
+        if (mode == "entries") {
+            benchEntries();
+        } else if (mode == "resolve") {
+            benchResolve();
+        } else if (mode == "components") {
+            benchComponents();
+        } else if (mode == "paths") {
+            benchPaths();
+        } else {
+            std::cout << "Usage: " << argv[0] << " [entries] [resolve] [components] [paths]" << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// read_latency.cpp - lookup latency while another session writes
+//
+// One writer session keeps creating small subtrees (a directory holding
+// eight files and a subdirectory) below random directories and removing
+// them again with rm -r. Meanwhile 'readers' sessions cd to random
+// directories as fast as they can, optionally also running ls there and,
+// now and then, a find. Reports read throughput and the latency
+// distribution of the reads, then the writer's progress.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o read_latency bench/read_latency.cpp
+// Usage: ./read_latency [-r readers] [-d seconds] [--keep] [--ls] [--find]
+//        --keep leaves the subtrees in place instead of removing them
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <iomanip>
+#include <random>
+
+namespace {
+
+// Swallows command output so that only the commands themselves are timed
+struct NullBuffer : std::streambuf {
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int readers = 2;
+    double seconds = 2;
+    bool removes = true, listings = false, finds = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "-r" && i + 1 < argc) {
+            readers = std::stoi(argv[++i]);
+        } else if (option == "-d" && i + 1 < argc) {
+            seconds = std::stod(argv[++i]);
+        } else if (option == "--keep") {
+            removes = false;
+        } else if (option == "--ls") {
+            listings = true;
+        } else if (option == "--find") {
+            finds = true;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [-r readers] [-d seconds] [--keep] [--ls] [--find]" << '\n';
+            return 1;
+        }
+    }
+
+    NullBuffer discard;
+    std::ostream discarded(&discard);
+    FileSystem fs;
+
+    // 64 directories of 16 subdirectories, each with a 'deep' directory
+    // that readers visit and the writer creates its subtrees in
+    std::vector<std::string> paths;
+    {
+        Session setup(discarded);
+        for (int d = 0; d < 64; ++d) {
+            std::string top = "/d" + std::to_string(d);
+            fs.cd(setup, "/");
+            fs.mkdir(setup, top.substr(1));
+            for (int s = 0; s < 16; ++s) {
+                std::string middle = top + "/s" + std::to_string(s);
+                fs.cd(setup, top);
+                fs.mkdir(setup, middle.substr(top.size() + 1));
+                fs.cd(setup, middle);
+                fs.mkdir(setup, "deep");
+                paths.push_back(middle + "/deep");
+            }
+        }
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> writes{0};
+    std::thread writer([&] {
+        Session session(discarded);
+        std::mt19937 rng(1);
+        for (size_t round = 0; !stop.load(); ++round) {
+            const std::string& path = paths[rng() % paths.size()];
+            std::string subtree = "w" + std::to_string(round);
+            fs.cd(session, path);
+            fs.mkdir(session, subtree);
+            fs.cd(session, subtree);
+            for (int i = 0; i < 8; ++i) {
+                fs.touch(session, "f" + std::to_string(i));
+            }
+            fs.mkdir(session, "sub");
+            fs.cd(session, path);
+            writes += 10;
+            if (removes) {
+                fs.rm(session, subtree, true);
+                ++writes;
+            }
+        }
+    });
+
+    std::vector<std::vector<uint32_t>> latencies(readers);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < readers; ++t) {
+        pool.emplace_back([&, t] {
+            Session session(discarded);
+            std::mt19937 rng(t + 17);
+            std::vector<uint32_t>& mine = latencies[t];
+            while (!stop.load(std::memory_order_relaxed)) {
+                const std::string& path = paths[rng() % paths.size()];
+                auto start = std::chrono::steady_clock::now();
+                fs.cd(session, path);
+                if (listings) {
+                    fs.ls(session);
+                }
+                if (finds && (rng() & 255) == 0) {
+                    fs.find(session, "f3");
+                }
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+                mine.push_back(static_cast<uint32_t>(nanoseconds));
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    writer.join();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    std::vector<uint32_t> all;
+    for (const auto& mine : latencies) {
+        all.insert(all.end(), mine.begin(), mine.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) {
+        return all.empty() ? 0u : all[std::min(all.size() - 1, static_cast<size_t>(all.size() * p))];
+    };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << readers << " readers, " << all.size() << " reads in " << seconds << " s ("
+              << all.size() / seconds / 1e6 << " M/s), " << writes.load() << " nodes written" << '\n';
+    std::cout << "read latency (ns): p50 " << percentile(0.5) << "  p99 " << percentile(0.99) << "  p99.9 "
+              << percentile(0.999) << "  max " << (all.empty() ? 0u : all.back()) << '\n';
+    return 0;
+}
@@ -0,0 +1,234 @@
+// script_bench.cpp - whole-program runs of the navigator on a generated script
+//
+// Writes a script of mkdir, touch and cd lines that builds a tree, then runs
+// the navigator's own main on it with standard output thrown away, and
+// reports the time taken (tearing the tree down included), the lines per
+// second and how many times operator new was called. Because it drives the
+// navigator through its command line only, it also builds against older
+// revisions of navigator.cpp, so the same run can be compared before and
+// after a change:
+//
+//   git show <revision>:navigator.cpp > /tmp/old.cpp
+//   g++ -std=c++17 -O2 -pthread -DNAVIGATOR_SOURCE='"/tmp/old.cpp"' -o script_bench_old bench/script_bench.cpp
+//
+// Shapes of tree:
+//   tree    directories of 10 subdirectories of 30 files each, with file and
+//           subdirectory names that repeat across directories (default)
+//   deep    one chain of nested directories
+//   wide    every node a file in one directory
+//   random  nodes below random directories, a quarter of them directories,
+//           each reached with cd and an absolute path
+//
+// Build: g++ -std=c++17 -O2 -pthread -o script_bench bench/script_bench.cpp
+// Usage: ./script_bench [nodes] [--shape tree|deep|wide|random] [-f]
+//                       [--then count command]
+//        -f         runs the script with -f instead of through the prompt
+//        --then     appends 'count' copies of 'command' after the tree is built
+
+#ifndef NAVIGATOR_SOURCE
+#define NAVIGATOR_SOURCE "../navigator.cpp"
+#endif
+
+#define main navigator_main
+#include NAVIGATOR_SOURCE
+#undef main
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <new>
+#include <random>
+#include <type_traits>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+void* allocate(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* allocateAligned(size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* memory = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+// Every allocation of the program goes through these, so counting here
+// counts the navigator's nodes, names, indexes and strings alike
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace {
+
+const char* const EXTENSIONS[] = {".c", ".h", ".txt", ".json", ""};
+
+// Writes the script and returns its number of lines
+size_t writeScript(std::ostream& out, const std::string& shape, size_t nodes) {
+    size_t lines = 0;
+    size_t made = 0;
+    if (shape == "tree") {
+        for (size_t i = 0; made < nodes; ++i) {
+            out << "mkdir dir_" << i << "\ncd dir_" << i << '\n';
+            lines += 2;
+            ++made;
+            for (size_t j = 0; j < 10 && made < nodes; ++j) {
+                out << "mkdir sub_" << j << "\ncd sub_" << j << '\n';
+                lines += 2;
+                ++made;
+                for (size_t k = 0; k < 30 && made < nodes; ++k, ++made, ++lines) {
+                    out << "touch file_" << k << EXTENSIONS[k % 5] << '\n';
+                }
+                out << "cd ..\n";
+                ++lines;
+            }
+            out << "cd ..\n";
+            ++lines;
+        }
+    } else if (shape == "deep") {
+        for (; made < nodes; ++made, lines += 2) {
+            out << "mkdir d\ncd d\n";
+        }
+    } else if (shape == "wide") {
+        for (; made < nodes; ++made, ++lines) {
+            out << "touch file_" << made << '\n';
+        }
+    } else {
+        std::mt19937 rng(7);
+        std::vector<std::string> directories{"/"};
+        for (; made < nodes; ++made, lines += 2) {
+            const std::string& parent = directories[rng() % directories.size()];
+            out << "cd " << parent << '\n';
+            if (rng() % 4 == 0) {
+                std::string name = "dir_" + std::to_string(made);
+                out << "mkdir " << name << '\n';
+                directories.push_back((parent == "/" ? parent : parent + "/") + name);
+            } else {
+                out << "touch file_" << rng() % (nodes / 8 + 1) << EXTENSIONS[rng() % 5] << '\n';
+            }
+        }
+    }
+    out << "cd /\n";
+    return lines + 1;
+}
+
+// Runs the navigator's main with -f when asked to and when it has one
+// (the first revisions' main takes no arguments and reads standard input)
+template <typename Main>
+bool runNavigator(Main& navigator, bool scriptOption, char* arguments[]) {
+    if constexpr (std::is_invocable_v<Main&, int, char**>) {
+        navigator(scriptOption ? 3 : 1, arguments);
+        return true;
+    } else {
+        if (!scriptOption) {
+            navigator();
+        }
+        return !scriptOption;
+    }
+}
+
+// Peak resident set size in megabytes (Linux only; 0 elsewhere)
+long peakMegabytes() {
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stol(line.substr(6)) / 1024;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t nodes = 1000000;
+    std::string shape = "tree";
+    bool scriptOption = false;
+    size_t repeats = 0;
+    std::string repeated;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--shape" && i + 1 < argc) {
+            shape = argv[++i];
+        } else if (option == "-f") {
+            scriptOption = true;
+        } else if (option == "--then" && i + 2 < argc) {
+            repeats = std::stoul(argv[++i]);
+            repeated = argv[++i];
+        } else if (std::isdigit(static_cast<unsigned char>(option[0]))) {
+            nodes = std::stoul(option);
+        } else {
+            std::cout << "Usage: " << argv[0]
+                      << " [nodes] [--shape tree|deep|wide|random] [-f] [--then count command]" << '\n';
+            return 1;
+        }
+    }
+    if (shape != "tree" && shape != "deep" && shape != "wide" && shape != "random") {
+        std::cout << "Error: Unknown shape '" << shape << "'." << '\n';
+        return 1;
+    }
+
+    std::string scriptFile = "script_bench.txt";
+    size_t lines;
+    {
+        std::ofstream script(scriptFile);
+        lines = writeScript(script, shape, nodes);
+        for (size_t i = 0; i < repeats; ++i, ++lines) {
+            script << repeated << '\n';
+        }
+        script << "exit\n";
+    }
+
+    // The navigator reads the script on standard input and writes to
+    // /dev/null; the report goes to the original standard output
+    std::cout.flush();
+    int report = dup(STDOUT_FILENO);
+    int input = open(scriptFile.c_str(), O_RDONLY);
+    int output = open("/dev/null", O_WRONLY);
+    dup2(input, STDIN_FILENO);
+    dup2(output, STDOUT_FILENO);
+    close(input);
+    close(output);
+
+    char program[] = "navigator";
+    char fileOption[] = "-f";
+    char* arguments[] = {program, fileOption, scriptFile.data(), nullptr};
+    size_t allocatedBefore = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    if (!runNavigator(navigator_main, scriptOption, arguments)) {
+        dprintf(report, "Error: This navigator has no -f option.\n");
+        return 1;
+    }
+    std::cout.flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t allocated = allocations.load() - allocatedBefore;
+    std::remove(scriptFile.c_str());
+
+    dprintf(report, "%zu lines (%s, %zu nodes%s) in %.0f ms: %.0f lines/s, %zu allocations, peak %ld MB\n", lines,
+            shape.c_str(), nodes, scriptOption ? ", -f" : "", seconds * 1000, lines / seconds, allocated,
+            peakMegabytes());
+    return 0;
+}
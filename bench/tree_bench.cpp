@@ -0,0 +1,249 @@
+// tree_bench.cpp - single-session timings of the navigator's commands
+//
+// Builds a random tree through mkdir and touch, then times the read
+// commands and export on it three times over: as built, after rounds of rm
+// and touch have aged it, and after compact. Then times save and load of a
+// snapshot, and the read commands once more after freeze. Every number is
+// the best of five runs. Also reports how much memory the tree adds to the
+// process and prints stats at each step.
+//
+// The tree has 'nodes' nodes below random directories, a quarter of them
+// directories. Directory names are unique; file names are drawn from
+// nodes/8 names such as "file_123.h", so find has several hits per name.
+// One extra directory, /big, holds 10000 files for ls.
+//
+// find is timed through the name index and as a scan of every node with
+// -j 1 and -j threads, and once for each kind of pattern find tells apart
+// (see NameMatcher). --level picks the search kernels the pattern searches
+// use instead of the best one the CPU supports.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o tree_bench bench/tree_bench.cpp
+// Usage: ./tree_bench [nodes] [-j threads] [--level scalar|sse2|avx2]
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <iomanip>
+#include <random>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+// Swallows command output so that only the commands themselves are timed
+struct NullBuffer : std::streambuf {
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+template <typename F>
+double millis(F run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename F>
+double bestOf(int runs, F run) {
+    double best = millis(run);
+    for (int i = 1; i < runs; ++i) {
+        best = std::min(best, millis(run));
+    }
+    return best;
+}
+
+// Resident set size in megabytes (Linux only; 0 elsewhere), after handing
+// freed memory back to the system
+long residentMegabytes() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            return std::stol(line.substr(6)) / 1024;
+        }
+    }
+    return 0;
+}
+
+struct Tree {
+    std::vector<std::string> directories{"/"};
+    std::vector<std::pair<size_t, std::string>> files; // Directory index and name
+};
+
+const char* const EXTENSIONS[] = {".c", ".h", ".txt", ".json", ""};
+
+// One pattern of each kind NameMatcher tells apart
+struct Pattern {
+    const char* kind;
+    const char* text;
+    FindMode mode;
+};
+
+const Pattern PATTERNS[] = {
+    {"literal", "file_77.h", FindMode::GLOB},
+    {"prefix", "file_77*", FindMode::GLOB},
+    {"suffix", "*_77.h", FindMode::GLOB},
+    {"contains", "*_77*", FindMode::GLOB},
+    {"glob", "file_7?.h", FindMode::GLOB},
+    {"regex", "file_7[0-9]\\.h", FindMode::REGEX},
+};
+
+void addFiles(FileSystem& fs, Session& session, Tree& tree, std::mt19937& rng, size_t count, size_t nameCount) {
+    for (size_t i = 0; i < count; ++i) {
+        size_t directory = rng() % tree.directories.size();
+        std::string name = "file_" + std::to_string(rng() % nameCount) + EXTENSIONS[rng() % 5];
+        fs.cd(session, tree.directories[directory]);
+        fs.touch(session, name);
+        tree.files.emplace_back(directory, name);
+    }
+}
+
+void measure(FileSystem& fs, Session& session, const Tree& tree, const char* label, size_t threads) {
+    std::mt19937 rng(3);
+    std::vector<std::string> paths;
+    for (int i = 0; i < 20000; ++i) {
+        paths.push_back(tree.directories[rng() % tree.directories.size()]);
+    }
+    double cd = bestOf(5, [&] {
+        for (const auto& path : paths) {
+            fs.cd(session, path);
+        }
+    }) * 1000 / paths.size();
+    double pwd = bestOf(5, [&] {
+        for (const auto& path : paths) {
+            fs.cd(session, path);
+            fs.cd(session, "..");
+            fs.pwd(session);
+        }
+    }) * 1000 / paths.size();
+    // A file name that exists, so find has hits to report
+    std::string literal = tree.files[rng() % tree.files.size()].second;
+    fs.cd(session, "/big");
+    double ls = bestOf(5, [&] { fs.ls(session); });
+    double indexed = bestOf(5, [&] { fs.find(session, literal); });
+    double scanned = bestOf(5, [&] { fs.find(session, literal, FindMode::EXACT, 1); });
+    double parallel = bestOf(5, [&] { fs.find(session, literal, FindMode::EXACT, threads); });
+    std::cout << label << ": cd " << cd << " us, cd .. + pwd " << pwd << " us, ls of 10000 " << ls << " ms, find "
+              << literal << ": index " << indexed << " ms, scan -j 1 " << scanned << " ms, scan -j " << threads << ' '
+              << parallel << " ms";
+    if (std::string(label) != "frozen") {
+        // export and save refuse to run on a frozen tree
+        double exported = bestOf(5, [&] { fs.exportTree(session, "/dev/null", false); });
+        double nested = bestOf(5, [&] { fs.exportTree(session, "/dev/null", true); });
+        std::cout << ", export " << exported << " ms, export -json " << nested << " ms";
+    }
+    std::cout << '\n' << label;
+    const char* separator = " patterns: ";
+    for (const auto& pattern : PATTERNS) {
+        double found = bestOf(5, [&] { fs.find(session, pattern.text, pattern.mode); });
+        std::cout << separator << pattern.kind << ' ' << found << " ms";
+        separator = ", ";
+    }
+    std::cout << '\n';
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t nodes = 1000000;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "-j" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if (option == "--level" && i + 1 < argc) {
+            std::string name = argv[++i];
+            NameKernels::Level level = name == "avx2"   ? NameKernels::Level::AVX2
+                                       : name == "sse2" ? NameKernels::Level::SSE2
+                                                        : NameKernels::Level::SCALAR;
+            if (name != "scalar" && name != "sse2" && name != "avx2") {
+                std::cout << "Error: Unknown kernel level '" << name << "'." << '\n';
+                return 1;
+            }
+            if (level > NameKernels::detectLevel()) {
+                std::cout << "Error: This CPU or build has no " << NameKernels::levelName(level) << " kernels." << '\n';
+                return 1;
+            }
+            NameKernels::currentLevel() = level;
+        } else if (std::isdigit(static_cast<unsigned char>(option[0]))) {
+            nodes = std::stoul(option);
+        } else {
+            std::cout << "Usage: " << argv[0] << " [nodes] [-j threads] [--level scalar|sse2|avx2]" << '\n';
+            return 1;
+        }
+    }
+    size_t nameCount = nodes / 8 + 1;
+    std::cout << std::fixed << std::setprecision(3);
+
+    NullBuffer discard;
+    std::ostream discarded(&discard);
+    Session session(discarded);
+    Session report(std::cout);
+    std::mt19937 rng(7);
+    long before = residentMegabytes();
+
+    FileSystem fs;
+    Tree tree;
+    double build = millis([&] {
+        for (size_t i = 0; i < nodes; ++i) {
+            if (rng() % 4 == 0) {
+                const std::string& parent = tree.directories[rng() % tree.directories.size()];
+                std::string name = "dir_" + std::to_string(i);
+                fs.cd(session, parent);
+                fs.mkdir(session, name);
+                tree.directories.push_back((parent == "/" ? parent : parent + "/") + name);
+            } else {
+                addFiles(fs, session, tree, rng, 1, nameCount);
+            }
+        }
+        fs.cd(session, "/");
+        fs.mkdir(session, "big");
+        fs.cd(session, "big");
+        for (int i = 0; i < 10000; ++i) {
+            fs.touch(session, "entry_" + std::to_string(i * 7919 % 10000));
+        }
+    });
+    std::cout << "Built " << nodes << " nodes in " << build << " ms, +" << residentMegabytes() - before
+              << " MB resident" << '\n';
+    fs.stats(report);
+    measure(fs, session, tree, "built", threads);
+
+    // Three rounds of removing a random half of the files and creating as
+    // many again leave gaps and scatter siblings across memory
+    double aging = millis([&] {
+        for (int round = 0; round < 3; ++round) {
+            std::shuffle(tree.files.begin(), tree.files.end(), rng);
+            size_t keep = tree.files.size() / 2;
+            for (size_t i = keep; i < tree.files.size(); ++i) {
+                fs.cd(session, tree.directories[tree.files[i].first]);
+                fs.rm(session, tree.files[i].second, false);
+            }
+            size_t removed = tree.files.size() - keep;
+            tree.files.resize(keep);
+            addFiles(fs, session, tree, rng, removed, nameCount);
+        }
+    });
+    std::cout << "Aged the tree in " << aging << " ms" << '\n';
+    fs.stats(report);
+    measure(fs, session, tree, "aged", threads);
+
+    fs.compact(report);
+    fs.stats(report);
+    measure(fs, session, tree, "compacted", threads);
+
+    std::string snapshot = "tree_bench.bin";
+    double save = bestOf(5, [&] { fs.save(session, snapshot); });
+    double load = bestOf(5, [&] { fs.load(session, snapshot); });
+    std::remove(snapshot.c_str());
+    std::cout << "save " << save << " ms, load " << load << " ms" << '\n';
+
+    fs.freeze(report);
+    fs.stats(report);
+    measure(fs, session, tree, "frozen", threads);
+    std::cout << "Frozen tree: +" << residentMegabytes() - before << " MB resident" << '\n';
+    return 0;
+}
@@ -0,0 +1,303 @@
+// loadgen.cpp - load generator for the navigator's server mode
+//
+// Opens many client connections to a navigator started with --serve and
+// keeps each of them busy with a mix of commands for a fixed time, then
+// reports throughput and the latency distribution of the answers. Every
+// client sends a frame of 'depth' commands in one write and sends the next
+// frame as soon as all of their answers have arrived; latency is measured
+// per frame.
+//
+// Build: g++ -std=c++17 -O2 -o loadgen loadgen.cpp
+// Usage: ./loadgen <socket> [-c clients] [-d seconds] [-p depth]
+//                  [-w write-percent] [-n cd-percent]
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+// Test tree created under /loadgen before the run: DIRECTORY_COUNT
+// directories with SUBDIRECTORY_COUNT subdirectories each
+constexpr int DIRECTORY_COUNT = 32;
+constexpr int SUBDIRECTORY_COUNT = 16;
+
+// Connects to the server; returns -1 on failure
+int connect_to(const std::string& socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+bool send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent < 0 && errno != EINTR && errno != EAGAIN) {
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(std::max<ssize_t>(sent, 0)));
+    }
+    return true;
+}
+
+// Reads answers from a socket and splits them at their length headers
+class AnswerReader {
+private:
+    std::string buffer;
+    size_t start = 0;
+
+public:
+    // Appends received bytes
+    void add(const char* data, size_t size) {
+        if (start == buffer.size()) {
+            buffer.clear();
+            start = 0;
+        }
+        buffer.append(data, size);
+    }
+
+    // Removes one complete answer from the buffer; false if none is complete
+    bool next(std::string_view& answer) {
+        size_t newline = buffer.find('\n', start);
+        if (newline == std::string::npos) {
+            return false;
+        }
+        size_t length = 0;
+        std::from_chars(buffer.data() + start, buffer.data() + newline, length);
+        if (buffer.size() - newline - 1 < length) {
+            return false;
+        }
+        answer = std::string_view(buffer.data() + newline + 1, length);
+        start = newline + 1 + length;
+        return true;
+    }
+};
+
+// Sends one command on a blocking connection and waits for its answer
+bool run_blocking(int fd, AnswerReader& reader, const std::string& command) {
+    if (!send_all(fd, command + "\n")) {
+        return false;
+    }
+    std::string_view answer;
+    char data[4096];
+    while (!reader.next(answer)) {
+        ssize_t received = ::recv(fd, data, sizeof(data), 0);
+        if (received <= 0) {
+            return false;
+        }
+        reader.add(data, static_cast<size_t>(received));
+    }
+    return true;
+}
+
+struct Client {
+    int fd = -1;
+    int id = 0;
+    AnswerReader reader;
+    Clock::time_point sentAt;
+    size_t awaiting = 0; // Answers still missing from the current frame
+    uint64_t created = 0;
+};
+
+// Share of each kind of command, in percent
+struct CommandMix {
+    long writes = 5; // mkdir or touch of a new name
+    long moves = 40; // cd to a random test directory
+    // The rest are reads: pwd, ls and find
+};
+
+// Appends the next command for a client
+void add_command(std::string& frame, Client& client, std::mt19937& rng, const CommandMix& mix) {
+    long roll = static_cast<long>(rng() % 100);
+    if (roll < mix.writes) {
+        frame += roll % 2 == 0 ? "mkdir c" : "touch c";
+        frame += std::to_string(client.id) + "_" + std::to_string(client.created++) + "\n";
+        return;
+    }
+    roll = static_cast<long>(rng() % 100);
+    if (roll < mix.moves) {
+        frame += "cd /loadgen/d" + std::to_string(rng() % DIRECTORY_COUNT) + "/s" +
+                 std::to_string(rng() % SUBDIRECTORY_COUNT) + "\n";
+    } else if (roll < mix.moves + (100 - mix.moves) * 40 / 100) {
+        frame += "pwd\n";
+    } else if (roll < mix.moves + (100 - mix.moves) * 75 / 100) {
+        frame += "ls\n";
+    } else {
+        frame += "find d" + std::to_string(rng() % DIRECTORY_COUNT) + "\n";
+    }
+}
+
+// Sends a client its next frame of commands
+bool send_frame(Client& client, std::mt19937& rng, const CommandMix& mix, size_t depth) {
+    std::string frame;
+    for (size_t i = 0; i < depth; ++i) {
+        add_command(frame, client, rng, mix);
+    }
+    client.awaiting = depth;
+    client.sentAt = Clock::now();
+    return send_all(client.fd, frame);
+}
+
+bool parse_number(const char* text, long& value) {
+    auto parsed = std::from_chars(text, text + std::strlen(text), value);
+    return parsed.ec == std::errc() && *parsed.ptr == '\0' && value >= 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* usage = " <socket> [-c clients] [-d seconds] [-p depth] [-w write-percent] [-n cd-percent]";
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << usage << '\n';
+        return 1;
+    }
+    std::string socketPath = argv[1];
+    long clientCount = 1000;
+    long seconds = 5;
+    long depth = 1;
+    CommandMix mix;
+    for (int i = 2; i < argc; ++i) {
+        std::string option = argv[i];
+        long* target = option == "-c"   ? &clientCount
+                       : option == "-d" ? &seconds
+                       : option == "-p" ? &depth
+                       : option == "-w" ? &mix.writes
+                       : option == "-n" ? &mix.moves
+                                        : nullptr;
+        if (target == nullptr || i + 1 >= argc || !parse_number(argv[++i], *target) || clientCount == 0 ||
+            depth == 0 || mix.writes > 100 || mix.moves > 100) {
+            std::cout << "Usage: " << argv[0] << usage << '\n';
+            return 1;
+        }
+    }
+
+    // Build the test tree; names that already exist from an earlier run
+    // are reported by the server and ignored here
+    int setup = connect_to(socketPath);
+    if (setup < 0) {
+        std::cout << "Error: Cannot connect to '" << socketPath << "'." << '\n';
+        return 1;
+    }
+    AnswerReader setupReader;
+    bool ok = run_blocking(setup, setupReader, "cd /") && run_blocking(setup, setupReader, "mkdir loadgen");
+    for (int d = 0; ok && d < DIRECTORY_COUNT; ++d) {
+        std::string directory = "/loadgen/d" + std::to_string(d);
+        ok = run_blocking(setup, setupReader, "cd /loadgen") &&
+             run_blocking(setup, setupReader, "mkdir d" + std::to_string(d)) &&
+             run_blocking(setup, setupReader, "cd " + directory);
+        for (int s = 0; ok && s < SUBDIRECTORY_COUNT; ++s) {
+            ok = run_blocking(setup, setupReader, "mkdir s" + std::to_string(s));
+        }
+    }
+    ::close(setup);
+    if (!ok) {
+        std::cout << "Error: The server closed the connection during setup." << '\n';
+        return 1;
+    }
+
+    int epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<Client> clients(static_cast<size_t>(clientCount));
+    std::mt19937 rng(12345);
+    for (size_t i = 0; i < clients.size(); ++i) {
+        Client& client = clients[i];
+        client.id = static_cast<int>(i);
+        client.fd = connect_to(socketPath);
+        if (client.fd < 0) {
+            std::cout << "Error: Connection " << i << " failed: " << std::strerror(errno) << '\n';
+            return 1;
+        }
+        ::fcntl(client.fd, F_SETFL, ::fcntl(client.fd, F_GETFL) | O_NONBLOCK);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = &client;
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, client.fd, &event);
+    }
+
+    std::vector<uint32_t> latencies;
+    latencies.reserve(1 << 22);
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::seconds(seconds);
+    size_t requests = 0;
+    for (Client& client : clients) {
+        if (!send_frame(client, rng, mix, static_cast<size_t>(depth))) {
+            std::cout << "Error: Send failed." << '\n';
+            return 1;
+        }
+    }
+
+    std::vector<epoll_event> events(256);
+    char data[1 << 16];
+    size_t outstanding = clients.size();
+    while (outstanding != 0) {
+        int count = ::epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 1000);
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+        auto now = Clock::now();
+        for (int i = 0; i < count; ++i) {
+            Client& client = *static_cast<Client*>(events[i].data.ptr);
+            ssize_t received;
+            while ((received = ::recv(client.fd, data, sizeof(data), 0)) > 0) {
+                client.reader.add(data, static_cast<size_t>(received));
+            }
+            if (received == 0) {
+                std::cout << "Error: The server closed connection " << client.id << '.' << '\n';
+                return 1;
+            }
+            std::string_view answer;
+            while (client.reader.next(answer)) {
+                ++requests;
+                if (--client.awaiting != 0) {
+                    continue;
+                }
+                latencies.push_back(static_cast<uint32_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - client.sentAt).count()));
+                if (now >= deadline) {
+                    --outstanding;
+                } else {
+                    send_frame(client, rng, mix, static_cast<size_t>(depth));
+                }
+            }
+        }
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    for (Client& client : clients) {
+        ::close(client.fd);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double fraction) {
+        if (latencies.empty()) {
+            return 0.0;
+        }
+        size_t index = std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * fraction));
+        return latencies[index] / 1000.0;
+    };
+    std::printf("%ld clients, depth %ld, %zu requests in %.2f s: %.0f requests/s\n", clientCount, depth, requests,
+                elapsed, requests / elapsed);
+    std::printf("frame latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", percentile(0.5),
+                percentile(0.9), percentile(0.99), percentile(0.999), percentile(1.0));
+    return 0;
+}
@@ -2,290 +2,5286 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <charconv>
+#include <regex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <sstream>
 #include <stdexcept>
 #include <memory>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <new>
+#include <optional>
 
 // Enum to distinguish between files and directories
-enum class NodeType {
+enum class NodeType : uint8_t {
     FILE,
     DIRECTORY
 };
 
-// Forward declaration of FileSystem class for the Node's find_helper
 class FileSystem;
 
-// Represents a single node (file or directory) in the file system tree
-class Node {
+// Bump allocator that hands out memory from large contiguous chunks.
+// Freed blocks whose size is a power of two are kept on per-size free lists
+// for reuse (growing vectors free exactly such blocks); all memory is
+// released at once when the arena is destroyed. Allocation is serialized by
+// an internal mutex so directories can grow from several threads.
+class Arena {
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunkSize;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t bytesUsed = 0;
+    size_t bytesReserved = 0;
+    FreeBlock* freeLists[64] = {};
+
+    // Index of the free list for a block size, or -1 if it is not recyclable
+    static int sizeClass(size_t size) {
+        if (size < sizeof(FreeBlock) || (size & (size - 1)) != 0) {
+            return -1;
+        }
+        int index = 0;
+        while ((size_t(1) << index) != size) {
+            ++index;
+        }
+        return index;
+    }
+
+    char* newChunk(size_t size) {
+        chunks.emplace_back(new char[size]);
+        bytesReserved += size;
+        return chunks.back().get();
+    }
+
+public:
+    explicit Arena(size_t chunkSize = 1 << 20) : chunkSize(chunkSize) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        std::lock_guard<std::mutex> lock(mutex);
+        bytesUsed += size;
+        int sc = sizeClass(size);
+        if (sc >= 0 && freeLists[sc] != nullptr) {
+            FreeBlock* block = freeLists[sc];
+            freeLists[sc] = block->next;
+            return block;
+        }
+        // Large requests get a chunk of their own so the current one is not abandoned
+        if (size + align > chunkSize / 2) {
+            return newChunk(size + align);
+        }
+        size_t padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+        if (cursor == nullptr || size + padding > static_cast<size_t>(limit - cursor)) {
+            cursor = newChunk(chunkSize);
+            limit = cursor + chunkSize;
+            padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+        }
+        char* result = cursor + padding;
+        cursor = result + size;
+        return result;
+    }
+
+    void deallocate(void* pointer, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        bytesUsed -= size;
+        int sc = sizeClass(size);
+        if (sc >= 0) {
+            FreeBlock* block = static_cast<FreeBlock*>(pointer);
+            block->next = freeLists[sc];
+            freeLists[sc] = block;
+        }
+    }
+
+    size_t getBytesUsed() const { return bytesUsed; }
+    size_t getBytesReserved() const { return bytesReserved; }
+    size_t getChunkCount() const { return chunks.size(); }
+};
+
+// std-compatible allocator adapter so standard containers can draw their
+// storage from an Arena.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    Arena* arena;
+
+    explicit ArenaAllocator(Arena* arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* pointer, size_t n) {
+        arena->deallocate(pointer, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+// Identifier of an interned name (see NameTable)
+using NameId = uint32_t;
+
+// Identifier of a node: its row in the FileSystem's NodeTable. 0 is no
+// node's id.
+using NodeId = uint32_t;
+constexpr NodeId NO_NODE = 0;
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NAVIGATOR_X86_KERNELS 1
+#endif
+
+// Asks the CPU to start loading the cache line at 'address', which is about
+// to be read. Never faults, so any pointer (even null) may be passed.
+inline void prefetchForRead(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address, 0, 3);
+#else
+    (void)address;
+#endif
+}
+
+// Byte-comparison kernels used to search the NameTable's contiguous name
+// blob. Every kernel has a portable scalar version; on x86 builds with GCC
+// or Clang, SSE2 and AVX2 versions are compiled as well and the best one the
+// CPU supports is picked at startup. Callers must keep PADDING readable bytes
+// after every buffer they pass in, since the vector loads overrun the data.
+namespace NameKernels {
+
+constexpr size_t PADDING = 32;
+
+enum class Level {
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+// Appends the index of every name in the blob that starts (or, with
+// 'atEnd', ends) with the needle. Name i spans [offsets[i], offsets[i + 1]).
+inline void matchEndsScalar(const char* blob, const uint32_t* offsets, size_t count,
+                            const char* needle, size_t length, bool atEnd, std::vector<NameId>& ids) {
+    for (size_t i = 0; i < count; ++i) {
+        if (offsets[i + 1] - offsets[i] >= length) {
+            const char* text = blob + (atEnd ? offsets[i + 1] - length : offsets[i]);
+            if (std::memcmp(text, needle, length) == 0) {
+                ids.push_back(static_cast<NameId>(i));
+            }
+        }
+    }
+}
+
+inline size_t findScalar(const char* text, size_t textLength, const char* needle, size_t needleLength) {
+    std::string_view haystack(text, textLength);
+    return haystack.find(std::string_view(needle, needleLength));
+}
+
+#ifdef NAVIGATOR_X86_KERNELS
+__attribute__((target("sse2"), always_inline))
+inline bool equalSse2(const char* a, const char* b, size_t length) {
+    for (; length >= 16; a += 16, b += 16, length -= 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) {
+            return false;
+        }
+    }
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    unsigned wanted = (1u << length) - 1;
+    return (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & wanted) == wanted;
+}
+
+__attribute__((target("avx2"), always_inline))
+inline bool equalAvx2(const char* a, const char* b, size_t length) {
+    for (; length >= 32; a += 32, b += 32, length -= 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))) != 0xFFFFFFFFu) {
+            return false;
+        }
+    }
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    uint32_t wanted = static_cast<uint32_t>((uint64_t(1) << length) - 1);
+    return (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))) & wanted) == wanted;
+}
+
+// The name loop is repeated per instruction set so that the comparison is
+// inlined and the dispatch cost is paid once per search, not once per name
+__attribute__((target("sse2")))
+inline void matchEndsSse2(const char* blob, const uint32_t* offsets, size_t count,
+                          const char* needle, size_t length, bool atEnd, std::vector<NameId>& ids) {
+    for (size_t i = 0; i < count; ++i) {
+        if (offsets[i + 1] - offsets[i] >= length) {
+            const char* text = blob + (atEnd ? offsets[i + 1] - length : offsets[i]);
+            if (equalSse2(text, needle, length)) {
+                ids.push_back(static_cast<NameId>(i));
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+inline void matchEndsAvx2(const char* blob, const uint32_t* offsets, size_t count,
+                          const char* needle, size_t length, bool atEnd, std::vector<NameId>& ids) {
+    for (size_t i = 0; i < count; ++i) {
+        if (offsets[i + 1] - offsets[i] >= length) {
+            const char* text = blob + (atEnd ? offsets[i + 1] - length : offsets[i]);
+            if (equalAvx2(text, needle, length)) {
+                ids.push_back(static_cast<NameId>(i));
+            }
+        }
+    }
+}
+
+// Substring search that filters candidate positions 16 (or 32) at a time by
+// comparing the needle's first and last characters, then verifies the
+// survivors with memcmp
+__attribute__((target("sse2")))
+inline size_t findSse2(const char* text, size_t textLength, const char* needle, size_t needleLength) {
+    if (needleLength == 0 || needleLength > textLength) {
+        return needleLength == 0 ? 0 : std::string_view::npos;
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+    size_t lastStart = textLength - needleLength;
+    for (size_t i = 0; i <= lastStart; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + needleLength - 1));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last))));
+        while (mask != 0) {
+            size_t position = i + static_cast<size_t>(__builtin_ctz(mask));
+            if (position > lastStart) {
+                break;
+            }
+            if (needleLength <= 2 || std::memcmp(text + position + 1, needle + 1, needleLength - 2) == 0) {
+                return position;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return std::string_view::npos;
+}
+
+__attribute__((target("avx2")))
+inline size_t findAvx2(const char* text, size_t textLength, const char* needle, size_t needleLength) {
+    if (needleLength == 0 || needleLength > textLength) {
+        return needleLength == 0 ? 0 : std::string_view::npos;
+    }
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+    size_t lastStart = textLength - needleLength;
+    for (size_t i = 0; i <= lastStart; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + needleLength - 1));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last))));
+        while (mask != 0) {
+            size_t position = i + static_cast<size_t>(__builtin_ctz(mask));
+            if (position > lastStart) {
+                break;
+            }
+            if (needleLength <= 2 || std::memcmp(text + position + 1, needle + 1, needleLength - 2) == 0) {
+                return position;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return std::string_view::npos;
+}
+#endif
+
+inline Level detectLevel() {
+#ifdef NAVIGATOR_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Level::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return Level::SSE2;
+    }
+#endif
+    return Level::SCALAR;
+}
+
+// The kernel level in use; detected once. tree_bench --level and the kernel
+// tests lower it to run the other kernels
+inline Level& currentLevel() {
+    static Level level = detectLevel();
+    return level;
+}
+
+inline const char* levelName(Level level) {
+    switch (level) {
+        case Level::AVX2: return "AVX2";
+        case Level::SSE2: return "SSE2";
+        default: return "scalar";
+    }
+}
+
+inline void matchEnds(const char* blob, const uint32_t* offsets, size_t count,
+                      const char* needle, size_t length, bool atEnd, std::vector<NameId>& ids) {
+#ifdef NAVIGATOR_X86_KERNELS
+    switch (currentLevel()) {
+        case Level::AVX2:
+            // A single 16-byte compare already covers short needles
+            if (length > 16) {
+                return matchEndsAvx2(blob, offsets, count, needle, length, atEnd, ids);
+            }
+            return matchEndsSse2(blob, offsets, count, needle, length, atEnd, ids);
+        case Level::SSE2:
+            return matchEndsSse2(blob, offsets, count, needle, length, atEnd, ids);
+        default:
+            break;
+    }
+#endif
+    matchEndsScalar(blob, offsets, count, needle, length, atEnd, ids);
+}
+
+inline size_t find(const char* text, size_t textLength, const char* needle, size_t needleLength) {
+#ifdef NAVIGATOR_X86_KERNELS
+    switch (currentLevel()) {
+        case Level::AVX2: return findAvx2(text, textLength, needle, needleLength);
+        case Level::SSE2: return findSse2(text, textLength, needle, needleLength);
+        default: break;
+    }
+#endif
+    return findScalar(text, textLength, needle, needleLength);
+}
+
+} // namespace NameKernels
+
+// Epoch-based reclamation for structures that are read without locks. A
+// reader works inside a ReadGuard, which publishes the global epoch the
+// thread entered in. A writer that unlinks memory hands it to a Reclaimer,
+// which notes the epoch at that moment and advances it; the memory is freed
+// only once every thread still inside a guard entered in a later epoch, so
+// nobody who could have reached it is still looking at it. Epochs and the
+// per-thread records are shared by the whole process.
+class Epochs {
+private:
+    static constexpr uint64_t IDLE = UINT64_MAX;
+
+    // One per thread that has entered a guard; reused after the thread exits
+    struct alignas(64) Reader {
+        std::atomic<uint64_t> epoch{IDLE};
+        std::atomic<bool> claimed{true};
+        Reader* next = nullptr;
+    };
+
+    // The calling thread's record and how deeply its guards are nested
+    struct ThreadState {
+        Reader* reader = nullptr;
+        size_t depth = 0;
+
+        ~ThreadState() {
+            if (reader != nullptr) {
+                reader->claimed.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    static std::atomic<uint64_t>& globalEpoch() {
+        static std::atomic<uint64_t> epoch{1};
+        return epoch;
+    }
+
+    // Records are never freed, so the list only ever grows at the front
+    static std::atomic<Reader*>& readers() {
+        static std::atomic<Reader*> head{nullptr};
+        return head;
+    }
+
+    static ThreadState& threadState() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    static Reader* claimReader() {
+        for (Reader* reader = readers().load(std::memory_order_acquire); reader != nullptr; reader = reader->next) {
+            bool claimed = false;
+            if (!reader->claimed.load(std::memory_order_relaxed) &&
+                reader->claimed.compare_exchange_strong(claimed, true, std::memory_order_acquire)) {
+                return reader;
+            }
+        }
+        Reader* reader = new Reader;
+        reader->next = readers().load(std::memory_order_relaxed);
+        while (!readers().compare_exchange_weak(reader->next, reader, std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+        }
+        return reader;
+    }
+
+public:
+    // Marks the calling thread as reading until it is destroyed. Guards
+    // nest; only the outermost one is published.
+    class ReadGuard {
+    public:
+        ReadGuard() {
+            ThreadState& state = threadState();
+            if (state.depth++ == 0) {
+                if (state.reader == nullptr) {
+                    state.reader = claimReader();
+                }
+                // A read-modify-write, like the one in oldestActive, so that
+                // either the collector sees this epoch or this thread sees
+                // every unlink made before the collector looked. Fences would
+                // do the same, but ThreadSanitizer cannot model them.
+                state.reader->epoch.exchange(globalEpoch().load(), std::memory_order_seq_cst);
+            }
+        }
+
+        ~ReadGuard() {
+            ThreadState& state = threadState();
+            if (--state.depth == 0) {
+                state.reader->epoch.store(IDLE, std::memory_order_release);
+            }
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    };
+
+    // True if the calling thread is inside a guard
+    static bool isReading() {
+        return threadState().depth != 0;
+    }
+
+    // Starts a new epoch and returns the one that just ended
+    static uint64_t advance() {
+        return globalEpoch().fetch_add(1);
+    }
+
+    // The oldest epoch any thread inside a guard entered in, or IDLE
+    static uint64_t oldestActive() {
+        uint64_t oldest = IDLE;
+        for (Reader* reader = readers().load(std::memory_order_acquire); reader != nullptr; reader = reader->next) {
+            // fetch_add(0) rather than a load; see ReadGuard
+            oldest = std::min(oldest, reader->epoch.fetch_add(0, std::memory_order_seq_cst));
+        }
+        return oldest;
+    }
+
+    // Waits until every thread that is inside a guard now has left it. The
+    // caller must not be inside one itself.
+    static void synchronize() {
+        uint64_t ended = advance();
+        while (oldestActive() <= ended) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+// Memory that lock-free readers may still be using, held until it is safe
+// to free (see Epochs)
+class Reclaimer {
+private:
+    static constexpr size_t COLLECT_INTERVAL = 64; // Retirements between collections
+
+    struct Retired {
+        uint64_t epoch;
+        std::function<void()> release;
+    };
+
+    std::mutex mutex;
+    std::deque<Retired> pending;
+    size_t sinceCollect = 0;
+
+public:
+    Reclaimer() = default;
+    Reclaimer(const Reclaimer&) = delete;
+    Reclaimer& operator=(const Reclaimer&) = delete;
+
+    // Nobody can be reading an object that is being destroyed
+    ~Reclaimer() {
+        for (auto& retired : pending) {
+            retired.release();
+        }
+    }
+
+    // Schedules 'release' to run once no reader can still see what it
+    // frees. Call it only after that memory has been unlinked.
+    void retire(std::function<void()> release) {
+        bool collectNow;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back({Epochs::advance(), std::move(release)});
+            collectNow = ++sinceCollect >= COLLECT_INTERVAL;
+        }
+        if (collectNow) {
+            collect();
+        }
+    }
+
+    // Frees everything that no reader can still be using
+    void collect() {
+        uint64_t oldest = Epochs::oldestActive();
+        std::lock_guard<std::mutex> lock(mutex);
+        sinceCollect = 0;
+        while (!pending.empty() && pending.front().epoch < oldest) {
+            pending.front().release();
+            pending.pop_front();
+        }
+    }
+
+    // Frees everything regardless of readers; for callers that know nobody
+    // can reach it any more
+    void releaseAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        sinceCollect = 0;
+        for (auto& retired : pending) {
+            retired.release();
+        }
+        pending.clear();
+    }
+
+    size_t getPendingCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending.size();
+    }
+
+    // Exchanges the pending lists of two reclaimers. Takes both locks, since
+    // rm and stats collect without holding treeLock and so can run while
+    // load swaps trees.
+    void swap(Reclaimer& other) {
+        std::scoped_lock lock(mutex, other.mutex);
+        pending.swap(other.pending);
+        std::swap(sinceCollect, other.sinceCollect);
+    }
+};
+
+// Array that one writer appends to while any number of readers index it
+// without locks. When it has to grow, the elements are copied into a buffer
+// twice the size and the new buffer is published. The old one is handed to
+// a Reclaimer, which frees it once no reader that loaded it earlier can
+// still be inside its guard; until then it still holds every element that
+// existed when it was loaded.
+template <typename T>
+class PublishedArray {
+private:
+    std::atomic<T*> current{nullptr};
+
+    template <typename U>
+    static void copyElement(const U& from, U& to) { to = from; }
+
+    template <typename U>
+    static void copyElement(const std::atomic<U>& from, std::atomic<U>& to) {
+        to.store(from.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    size_t capacity = 0;
+    std::unique_ptr<T[]> buffer; // The current one
+
+public:
+    const T* data() const { return current.load(std::memory_order_acquire); }
+
+    // Writer only: the current buffer, which may be written past the
+    // elements readers are allowed to see
+    T* writable() { return buffer.get(); }
+
+    // Writer only: makes room for 'needed' elements, keeping the first
+    // 'used'. The buffer it replaces goes to 'reclaimer'.
+    void reserve(size_t needed, size_t used, Reclaimer& reclaimer) {
+        if (needed <= capacity) {
+            return;
+        }
+        size_t newCapacity = std::max(needed, capacity * 2);
+        std::unique_ptr<T[]> grown(new T[newCapacity]());
+        for (size_t i = 0; i < used; ++i) {
+            copyElement(buffer[i], grown[i]);
+        }
+        capacity = newCapacity;
+        current.store(grown.get(), std::memory_order_release);
+        if (T* old = buffer.release()) {
+            reclaimer.retire([old] { delete[] old; });
+        }
+        buffer = std::move(grown);
+    }
+
+    // Not thread-safe: swaps two arrays nobody else is using
+    void swap(PublishedArray& other) {
+        T* mine = current.load(std::memory_order_relaxed);
+        current.store(other.current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        other.current.store(mine, std::memory_order_relaxed);
+        std::swap(capacity, other.capacity);
+        buffer.swap(other.buffer);
+    }
+
+    size_t getCapacity() const { return capacity; }
+};
+
+// Interns names so that each distinct string is stored exactly once, no
+// matter how many nodes across the tree carry it. Ids are dense, starting at 0.
+// The characters of all names live back to back in one blob so that pattern
+// searches can stream through them with the vector kernels above.
+//
+// lookup(), get() and size() never lock and may run while another thread
+// interns: intern() writes a new name completely, then publishes the new
+// count and finally the hash slot pointing at it. The pattern searches take
+// the write lock instead, because their vector loads run on past the last
+// name into the padding that the next intern() overwrites. Storage
+// replaced by growth goes to the Reclaimer passed to intern(), so lock-free
+// readers must be inside an Epochs guard.
+class NameTable {
+private:
+    struct Slot {
+        uint32_t hash;
+        NameId id; // EMPTY_ID if the slot is free
+    };
+    static constexpr NameId EMPTY_ID = UINT32_MAX;
+
+    // Open-addressing (linear probing) index from name hash to id. Storing
+    // the hash lets most probes skip the string comparison. Each slot is a
+    // Slot packed into one atomic word so that readers see it whole.
+    struct SlotTable {
+        size_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+        explicit SlotTable(size_t count) : mask(count - 1), slots(new std::atomic<uint64_t>[count]) {
+            for (size_t i = 0; i < count; ++i) {
+                slots[i].store(pack(Slot{0, EMPTY_ID}), std::memory_order_relaxed);
+            }
+        }
+    };
+
+    mutable std::mutex writeMutex; // Serializes intern() against itself and the searches
+    std::atomic<size_t> count{0};
+    // All names back to back, followed by NameKernels::PADDING zero bytes
+    PublishedArray<char> blob;
+    // offsets[id] is where name 'id' starts; offsets[count] is the end of the data
+    PublishedArray<uint32_t> offsets;
+    std::atomic<const SlotTable*> slotTable{nullptr};
+    std::unique_ptr<SlotTable> writableSlots; // The current table
+
+    static uint64_t pack(Slot slot) {
+        uint64_t word;
+        std::memcpy(&word, &slot, sizeof(word));
+        return word;
+    }
+
+    static Slot unpack(uint64_t word) {
+        Slot slot;
+        std::memcpy(&slot, &word, sizeof(slot));
+        return slot;
+    }
+
+    // FNV-1a rather than std::hash: the slots are saved in snapshots, so the
+    // hash must not change with the compiler or standard library. The final
+    // fold mixes the high bits into the low ones the slot index uses.
+    static uint32_t hashName(std::string_view name) {
+        uint32_t hash = 2166136261u;
+        for (char c : name) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        return hash ^ (hash >> 15);
+    }
+
+    // Slot holding 'name', or the free slot where it would be inserted
+    size_t probe(const SlotTable& table, std::string_view name, uint32_t hash, Slot& found) const {
+        size_t slot = hash & table.mask;
+        while (true) {
+            found = unpack(table.slots[slot].load(std::memory_order_acquire));
+            if (found.id == EMPTY_ID || (found.hash == hash && get(found.id) == name)) {
+                return slot;
+            }
+            slot = (slot + 1) & table.mask;
+        }
+    }
+
+    // Writer only: rehashes into a table twice the size and publishes it
+    void grow(Reclaimer& reclaimer) {
+        const SlotTable& old = *writableSlots;
+        auto table = std::make_unique<SlotTable>((old.mask + 1) * 2);
+        for (size_t i = 0; i <= old.mask; ++i) {
+            Slot entry = unpack(old.slots[i].load(std::memory_order_relaxed));
+            if (entry.id != EMPTY_ID) {
+                size_t slot = entry.hash & table->mask;
+                while (unpack(table->slots[slot].load(std::memory_order_relaxed)).id != EMPTY_ID) {
+                    slot = (slot + 1) & table->mask;
+                }
+                table->slots[slot].store(pack(entry), std::memory_order_relaxed);
+            }
+        }
+        slotTable.store(table.get(), std::memory_order_release);
+        SlotTable* replaced = writableSlots.release();
+        writableSlots = std::move(table);
+        reclaimer.retire([replaced] { delete replaced; });
+    }
+
+    // Replaces the contents of a table nobody else is using with 'names'
+    // names whose offsets and characters are given, and rebuilds nothing
+    // else. Nobody can be reading what it replaces, so that is freed at once.
+    void assign(const uint32_t* newOffsets, size_t names, const char* characters, size_t bytes) {
+        Reclaimer unshared;
+        offsets.reserve(names + 1, 0, unshared);
+        std::copy(newOffsets, newOffsets + names + 1, offsets.writable());
+        blob.reserve(bytes + NameKernels::PADDING, 0, unshared);
+        std::copy(characters, characters + bytes, blob.writable());
+        std::fill(blob.writable() + bytes, blob.writable() + bytes + NameKernels::PADDING, '\0');
+        count.store(names, std::memory_order_release);
+    }
+
+    // The needle followed by the padding the kernels may read past its end
+    static std::string padded(std::string_view needle) {
+        std::string result(needle);
+        result.append(NameKernels::PADDING, '\0');
+        return result;
+    }
+
+public:
+    NameTable() {
+        uint32_t start = 0;
+        assign(&start, 0, "", 0);
+        writableSlots = std::make_unique<SlotTable>(64);
+        slotTable.store(writableSlots.get(), std::memory_order_release);
+    }
+
+    NameTable(const NameTable&) = delete;
+    NameTable& operator=(const NameTable&) = delete;
+
+    // Storage that growth replaces goes to 'reclaimer'
+    NameId intern(std::string_view name, Reclaimer& reclaimer) {
+        NameId id;
+        if (lookup(name, id)) {
+            return id;
+        }
+        std::lock_guard<std::mutex> lock(writeMutex);
+        uint32_t hash = hashName(name);
+        Slot found;
+        size_t slot = probe(*writableSlots, name, hash, found);
+        if (found.id != EMPTY_ID) {
+            return found.id; // Interned by another thread meanwhile
+        }
+        size_t names = count.load(std::memory_order_relaxed);
+        size_t end = offsets.writable()[names];
+        blob.reserve(end + name.size() + NameKernels::PADDING, end, reclaimer);
+        std::copy(name.begin(), name.end(), blob.writable() + end);
+        std::fill(blob.writable() + end + name.size(), blob.writable() + end + name.size() + NameKernels::PADDING, '\0');
+        offsets.reserve(names + 2, names + 1, reclaimer);
+        offsets.writable()[names + 1] = static_cast<uint32_t>(end + name.size());
+        count.store(names + 1, std::memory_order_release);
+        id = static_cast<NameId>(names);
+        writableSlots->slots[slot].store(pack(Slot{hash, id}), std::memory_order_release);
+        // Keep the load factor at or below one half
+        if (size() * 2 > writableSlots->mask + 1) {
+            grow(reclaimer);
+        }
+        return id;
+    }
+
+    // Looks up an existing name without interning it
+    bool lookup(std::string_view name, NameId& id) const {
+        Slot found;
+        probe(*slotTable.load(std::memory_order_acquire), name, hashName(name), found);
+        if (found.id == EMPTY_ID) {
+            return false;
+        }
+        id = found.id;
+        return true;
+    }
+
+    // The view stays valid while the caller's guard (or the lock that keeps
+    // interning out) is held
+    std::string_view get(NameId id) const {
+        const uint32_t* starts = offsets.data();
+        return std::string_view(blob.data() + starts[id], starts[id + 1] - starts[id]);
+    }
+
+    size_t size() const { return count.load(std::memory_order_acquire); }
+    size_t getCharacterBytes() const { return offsets.data()[size()]; }
+
+    // Not thread-safe: exchanges the contents of two tables nobody else is using
+    void swap(NameTable& other) {
+        size_t names = count.load(std::memory_order_relaxed);
+        count.store(other.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        other.count.store(names, std::memory_order_relaxed);
+        blob.swap(other.blob);
+        offsets.swap(other.offsets);
+        const SlotTable* table = slotTable.load(std::memory_order_relaxed);
+        slotTable.store(other.slotTable.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        other.slotTable.store(table, std::memory_order_relaxed);
+        writableSlots.swap(other.writableSlots);
+    }
+
+    // Appends the ids of all names starting with 'prefix'
+    void findWithPrefix(std::string_view prefix, std::vector<NameId>& ids) const {
+        std::string needle = padded(prefix);
+        std::lock_guard<std::mutex> lock(writeMutex);
+        size_t names = size();
+        NameKernels::matchEnds(blob.data(), offsets.data(), names, needle.data(), prefix.size(), false, ids);
+    }
+
+    // Appends the ids of all names ending with 'suffix'
+    void findWithSuffix(std::string_view suffix, std::vector<NameId>& ids) const {
+        std::string needle = padded(suffix);
+        std::lock_guard<std::mutex> lock(writeMutex);
+        size_t names = size();
+        NameKernels::matchEnds(blob.data(), offsets.data(), names, needle.data(), suffix.size(), true, ids);
+    }
+
+    // Appends the ids of all names containing 'part'. The whole blob is
+    // searched in one pass; hits that straddle two names are skipped.
+    void findContaining(std::string_view part, std::vector<NameId>& ids) const {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        size_t names = size();
+        if (part.empty()) {
+            for (NameId id = 0; id < names; ++id) {
+                ids.push_back(id);
+            }
+            return;
+        }
+        std::string needle = padded(part);
+        const uint32_t* starts = offsets.data();
+        const char* characters = blob.data();
+        size_t end = starts[names];
+        size_t position = 0;
+        while (position < end) {
+            size_t hit = NameKernels::find(characters + position, end - position, needle.data(), part.size());
+            if (hit == std::string_view::npos) {
+                break;
+            }
+            hit += position;
+            NameId id = static_cast<NameId>(std::upper_bound(starts, starts + names + 1, hit) - starts - 1);
+            if (hit + part.size() <= starts[id + 1]) {
+                ids.push_back(id);
+                position = starts[id + 1];
+            } else {
+                position = hit + 1;
+            }
+        }
+    }
+
+    // Snapshot support: the offsets, hash slots and blob are written verbatim
+    // (native byte order) so that loading them is three bulk copies
+    void save(std::ostream& out) const {
+        size_t names = size();
+        const uint32_t* starts = offsets.data();
+        const SlotTable& table = *slotTable.load(std::memory_order_acquire);
+        uint32_t header[3] = {static_cast<uint32_t>(names), static_cast<uint32_t>(table.mask + 1), starts[names]};
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(starts), (names + 1) * sizeof(uint32_t));
+        std::vector<Slot> slots(table.mask + 1);
+        for (size_t i = 0; i < slots.size(); ++i) {
+            slots[i] = unpack(table.slots[i].load(std::memory_order_acquire));
+        }
+        out.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(Slot));
+        out.write(blob.data(), starts[names]);
+        // Keep whatever follows 4-byte aligned
+        out.write("\0\0\0", (4 - starts[names] % 4) % 4);
+    }
+
+    // Replaces the contents of a table nobody else is using with one saved
+    // by save(). Returns the number of bytes consumed, or 0 if the data is
+    // malformed.
+    size_t load(const char* data, size_t length) {
+        uint32_t header[3];
+        if (length < sizeof(header)) {
+            return 0;
+        }
+        std::memcpy(header, data, sizeof(header));
+        uint64_t names = header[0], slotCount = header[1], blobBytes = header[2];
+        uint64_t padding = (4 - blobBytes % 4) % 4;
+        uint64_t total = sizeof(header) + (names + 1) * sizeof(uint32_t) + slotCount * sizeof(Slot) + blobBytes + padding;
+        if (total > length || slotCount < 2 * names || slotCount < 2 || (slotCount & (slotCount - 1)) != 0) {
+            return 0;
+        }
+        const char* cursor = data + sizeof(header);
+        std::vector<uint32_t> newOffsets(names + 1);
+        std::memcpy(newOffsets.data(), cursor, newOffsets.size() * sizeof(uint32_t));
+        cursor += newOffsets.size() * sizeof(uint32_t);
+        if (newOffsets[0] != 0 || newOffsets.back() != blobBytes ||
+            !std::is_sorted(newOffsets.begin(), newOffsets.end())) {
+            return 0;
+        }
+        auto table = std::make_unique<SlotTable>(slotCount);
+        uint64_t used = 0;
+        for (size_t i = 0; i < slotCount; ++i) {
+            Slot slot;
+            std::memcpy(&slot, cursor + i * sizeof(Slot), sizeof(Slot));
+            if (slot.id != EMPTY_ID && (slot.id >= names || ++used > names)) {
+                return 0;
+            }
+            table->slots[i].store(pack(slot), std::memory_order_relaxed);
+        }
+        cursor += slotCount * sizeof(Slot);
+
+        NameTable loaded;
+        loaded.assign(newOffsets.data(), names, cursor, blobBytes);
+        loaded.writableSlots = std::move(table);
+        loaded.slotTable.store(loaded.writableSlots.get(), std::memory_order_relaxed);
+        swap(loaded);
+        return static_cast<size_t>(total);
+    }
+
+    // Approximate heap footprint: hash index, offsets and character blob
+    size_t getMemoryUsage() const {
+        return blob.getCapacity() + offsets.getCapacity() * sizeof(uint32_t) +
+               (writableSlots->mask + 1) * sizeof(uint64_t);
+    }
+};
+
+// The children of a directory, keyed by name id. Readers never lock: the
+// entries live in one block reached through an atomic pointer, and the
+// writer (who holds the directory's lock) only changes a published block in
+// ways a concurrent reader tolerates. A new entry is written into spare room
+// at the end, then counted, and only then added to the hash index; a removed
+// entry keeps its place with its node cleared. When the block is full its
+// live entries are copied into one twice the size, which is published before
+// the old block is handed to the Reclaimer. Small blocks are scanned; blocks
+// with room for more than SMALL_LIMIT entries also carry an open-addressing
+// (linear probing) hash index. Iteration order is unspecified; callers that
+// need name order sort the entries themselves.
+class DirectoryEntries {
+public:
+    struct Entry {
+        NameId name;
+        NodeId node;
+    };
+
+private:
+    static constexpr size_t SMALL_LIMIT = 32;
+    static constexpr size_t MIN_BLOCK_BYTES = 128;
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    struct Slot {
+        NameId name;
+        std::atomic<NodeId> node; // NO_NODE once the entry is removed
+    };
+
+    // Header of a block; the entries follow it, then the hash index if any.
+    // Blocks are a power of two in size so the arena can recycle them.
+    struct alignas(alignof(Slot)) Block {
+        uint32_t bytes;
+        uint32_t capacity;
+        uint32_t indexSize;                // A power of two, or 0 while small
+        std::atomic<uint32_t> count{0};    // Entries written, removed ones included
+        std::atomic<uint32_t> live{0};
+
+        Slot* entries() { return reinterpret_cast<Slot*>(this + 1); }
+        std::atomic<uint32_t>* index() { return reinterpret_cast<std::atomic<uint32_t>*>(entries() + capacity); }
+    };
+
+    std::atomic<Block*> block{nullptr};
+
+    static size_t hash(NameId name) {
+        return static_cast<uint32_t>(name * 0x9E3779B1u);
+    }
+
+    // Entries that fit in a block of 'bytes' with an index of 'indexSize'
+    // slots, keeping the index at most three quarters full
+    static size_t capacityFor(size_t bytes, size_t indexSize) {
+        size_t overhead = sizeof(Block) + indexSize * sizeof(uint32_t);
+        if (overhead >= bytes) {
+            return 0;
+        }
+        size_t capacity = (bytes - overhead) / sizeof(Slot);
+        return indexSize == 0 ? capacity : std::min(capacity, indexSize * 3 / 4);
+    }
+
+    // Allocates an empty block with room for at least 'needed' entries
+    static Block* allocate(size_t needed, Arena& arena) {
+        size_t bytes = MIN_BLOCK_BYTES;
+        size_t indexSize = 0;
+        while (true) {
+            indexSize = 0;
+            if (capacityFor(bytes, 0) > SMALL_LIMIT) {
+                indexSize = 64;
+                while (capacityFor(bytes, indexSize * 2) > capacityFor(bytes, indexSize)) {
+                    indexSize *= 2;
+                }
+            }
+            if (capacityFor(bytes, indexSize) >= needed) {
+                break;
+            }
+            bytes *= 2;
+        }
+        Block* result = new (arena.allocate(bytes, alignof(Block))) Block;
+        result->bytes = static_cast<uint32_t>(bytes);
+        result->capacity = static_cast<uint32_t>(capacityFor(bytes, indexSize));
+        result->indexSize = static_cast<uint32_t>(indexSize);
+        for (size_t i = 0; i < indexSize; ++i) {
+            new (&result->index()[i]) std::atomic<uint32_t>(EMPTY_SLOT);
+        }
+        return result;
+    }
+
+    // The entry for a name, live or removed, or nullptr if there is none
+    static Slot* locate(Block* current, NameId name) {
+        Slot* entries = current->entries();
+        if (current->indexSize == 0) {
+            // A linear scan beats binary search at this size
+            uint32_t count = current->count.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < count; ++i) {
+                if (entries[i].name == name) {
+                    return &entries[i];
+                }
+            }
+            return nullptr;
+        }
+        size_t mask = current->indexSize - 1;
+        for (size_t slot = hash(name) & mask;; slot = (slot + 1) & mask) {
+            uint32_t i = current->index()[slot].load(std::memory_order_acquire);
+            if (i == EMPTY_SLOT) {
+                return nullptr;
+            }
+            if (entries[i].name == name) {
+                return &entries[i];
+            }
+        }
+    }
+
+    // Writer only: adds an entry to a block known to have room
+    static Slot* append(Block* current, NameId name, NodeId node) {
+        uint32_t i = current->count.load(std::memory_order_relaxed);
+        Slot* entry = new (&current->entries()[i]) Slot{name, node};
+        current->count.store(i + 1, std::memory_order_release);
+        current->live.store(current->live.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (current->indexSize != 0) {
+            size_t mask = current->indexSize - 1;
+            size_t slot = hash(name) & mask;
+            while (current->index()[slot].load(std::memory_order_relaxed) != EMPTY_SLOT) {
+                slot = (slot + 1) & mask;
+            }
+            current->index()[slot].store(i, std::memory_order_release);
+        }
+        return entry;
+    }
+
+    // Writer only: moves the live entries into a new block with room for
+    // 'needed' and publishes it
+    Block* grow(size_t needed, Arena& arena, Reclaimer& reclaimer) {
+        Block* old = block.load(std::memory_order_relaxed);
+        Block* grown = allocate(needed, arena);
+        if (old != nullptr) {
+            uint32_t count = old->count.load(std::memory_order_relaxed);
+            for (uint32_t i = 0; i < count; ++i) {
+                NodeId node = old->entries()[i].node.load(std::memory_order_relaxed);
+                if (node != NO_NODE) {
+                    append(grown, old->entries()[i].name, node);
+                }
+            }
+        }
+        block.store(grown, std::memory_order_release);
+        if (old != nullptr) {
+            Arena* owner = &arena;
+            reclaimer.retire([owner, old] { owner->deallocate(old, old->bytes); });
+        }
+        return grown;
+    }
+
+public:
+    // Iterates over the live entries of one block as it was when the view
+    // was taken
+    class const_iterator {
+    private:
+        const Slot* position = nullptr;
+        const Slot* last = nullptr;
+        Entry current{};
+
+        void skipRemoved() {
+            for (; position != last; ++position) {
+                current.node = position->node.load(std::memory_order_acquire);
+                if (current.node != NO_NODE) {
+                    current.name = position->name;
+                    return;
+                }
+            }
+        }
+
+    public:
+        const_iterator() = default;
+        const_iterator(const Slot* position, const Slot* last) : position(position), last(last) { skipRemoved(); }
+
+        const Entry& operator*() const { return current; }
+        const Entry* operator->() const { return &current; }
+
+        const_iterator& operator++() {
+            ++position;
+            skipRemoved();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        // The node 'distance' entries further on, or NO_NODE if there is
+        // none; removed entries count towards the distance
+        NodeId peek(size_t distance) const {
+            return static_cast<size_t>(last - position) > distance
+                       ? position[distance].node.load(std::memory_order_relaxed)
+                       : NO_NODE;
+        }
+
+        bool operator==(const const_iterator& other) const { return position == other.position; }
+        bool operator!=(const const_iterator& other) const { return position != other.position; }
+
+        // Whether the iterator is past the last entry of its view
+        bool atEnd() const { return position == last; }
+    };
+
+    class View {
+    private:
+        const Slot* first = nullptr;
+        const Slot* last = nullptr;
+
+    public:
+        View() = default;
+        View(const Slot* first, const Slot* last) : first(first), last(last) {}
+
+        const_iterator begin() const { return const_iterator(first, last); }
+        const_iterator end() const { return const_iterator(last, last); }
+    };
+
+    DirectoryEntries() = default;
+    DirectoryEntries(const DirectoryEntries&) = delete;
+    DirectoryEntries& operator=(const DirectoryEntries&) = delete;
+
+    size_t size() const {
+        Block* current = block.load(std::memory_order_acquire);
+        return current == nullptr ? 0 : current->live.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // The entries as of now. A reader must stay inside an Epochs::ReadGuard
+    // while it uses the view.
+    View view() const {
+        Block* current = block.load(std::memory_order_acquire);
+        if (current == nullptr) {
+            return View();
+        }
+        const Slot* entries = current->entries();
+        return View(entries, entries + current->count.load(std::memory_order_acquire));
+    }
+
+    // Returns the child with the given name, or NO_NODE if there is none
+    NodeId find(NameId name) const {
+        Block* current = block.load(std::memory_order_acquire);
+        Slot* entry = current != nullptr ? locate(current, name) : nullptr;
+        return entry != nullptr ? entry->node.load(std::memory_order_acquire) : NO_NODE;
+    }
+
+    // Writer only: finds the entry for a name, adding one with NO_NODE if
+    // there is no live one, in a single probe. Returns the entry's node
+    // and whether it was added; the caller publishes the new node by storing
+    // it there.
+    std::pair<std::atomic<NodeId>*, bool> tryEmplace(NameId name, Arena& arena, Reclaimer& reclaimer) {
+        Block* current = block.load(std::memory_order_relaxed);
+        Slot* entry = current != nullptr ? locate(current, name) : nullptr;
+        if (entry != nullptr) {
+            if (entry->node.load(std::memory_order_relaxed) != NO_NODE) {
+                return {&entry->node, false};
+            }
+            // Bring the removed entry back rather than adding a second one
+            current->live.store(current->live.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return {&entry->node, true};
+        }
+        if (current == nullptr || current->count.load(std::memory_order_relaxed) == current->capacity) {
+            // Doubling past the live entries keeps appends amortized O(1)
+            current = grow(2 * (size() + 1), arena, reclaimer);
+        }
+        return {&append(current, name, NO_NODE)->node, true};
+    }
+
+    // Writer only: unlinks the child with the given name and returns it, or
+    // NO_NODE if there is none. Readers may still hold it until their guard
+    // ends.
+    NodeId remove(NameId name) {
+        Block* current = block.load(std::memory_order_relaxed);
+        Slot* entry = current != nullptr ? locate(current, name) : nullptr;
+        NodeId node = entry != nullptr ? entry->node.load(std::memory_order_relaxed) : NO_NODE;
+        if (node != NO_NODE) {
+            entry->node.store(NO_NODE, std::memory_order_release);
+            current->live.store(current->live.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    // Writer only: makes room for 'count' live entries in total
+    void reserve(size_t count, Arena& arena, Reclaimer& reclaimer) {
+        Block* current = block.load(std::memory_order_relaxed);
+        size_t extra = count > size() ? count - size() : 0;
+        if (current == nullptr ? count != 0 : current->capacity - current->count.load(std::memory_order_relaxed) < extra) {
+            grow(count, arena, reclaimer);
+        }
+    }
+
+    // Returns the block to the arena once the directory itself is freed
+    void release(Arena& arena) {
+        Block* current = block.exchange(nullptr, std::memory_order_relaxed);
+        if (current != nullptr) {
+            arena.deallocate(current, current->bytes);
+        }
+    }
+
+    // Bytes of arena storage held by this directory
+    size_t getMemoryUsage() const {
+        Block* current = block.load(std::memory_order_acquire);
+        return current == nullptr ? 0 : current->bytes;
+    }
+};
+
+// One column of a NodeTable. Rows live in chunks of CHUNK_ROWS that never
+// move once allocated, so readers index the column without locks while the
+// writer adds chunks, and a row updated in place (a removed flag, a child
+// index) is never lost to a copy. Only the small array of chunk pointers is
+// republished as it grows.
+template <typename T>
+class NodeColumn {
+private:
+    static constexpr size_t CHUNK_BITS = 12;
+    PublishedArray<T*> chunks;
+    std::vector<std::unique_ptr<T[]>> storage;
+
+public:
+    static constexpr size_t CHUNK_ROWS = size_t(1) << CHUNK_BITS;
+
+    // The row must be below a size the column was grown to
+    T& operator[](uint32_t row) const {
+        return chunks.data()[row >> CHUNK_BITS][row & (CHUNK_ROWS - 1)];
+    }
+
+    // Writer only: makes rows below 'count' usable. Replaced arrays of
+    // chunk pointers go to 'reclaimer'.
+    void grow(size_t count, Reclaimer& reclaimer) {
+        while (storage.size() * CHUNK_ROWS < count) {
+            storage.emplace_back(new T[CHUNK_ROWS]());
+            chunks.reserve(storage.size(), storage.size() - 1, reclaimer);
+            chunks.writable()[storage.size() - 1] = storage.back().get();
+        }
+    }
+
+    size_t getBytesReserved() const { return storage.size() * CHUNK_ROWS * sizeof(T); }
+};
+
+// The nodes of a tree, stored by column: one array per field, indexed by a
+// 32-bit NodeId, instead of one object per node reached through 64-bit
+// pointers. Ids are half the size of pointers in every child entry, parent
+// link and name chain, and a walk that reads only names touches only the
+// name column. Files and directories are numbered separately, with the top
+// bit of the id telling them apart, so a node's type is known without
+// reading anything and files carry no child index. Rows of freed nodes are
+// reused by the next ones created.
+//
+// Readers use the columns without locks (see NodeColumn); create and
+// destroy are for the one writer, which the FileSystem serializes with its
+// indexLock.
+class NodeTable {
+public:
+    static constexpr NodeId DIRECTORY_BIT = NodeId(1) << 31;
+
+private:
+    // The columns every node has
+    struct Rows {
+        NodeColumn<NameId> name;
+        NodeColumn<NodeId> parent;
+        NodeColumn<std::atomic<NodeId>> nextWithSameName; // Chain through the FileSystem's name index
+        NodeColumn<std::atomic<bool>> removed;            // Set once rm has unlinked the node
+        uint32_t used = 0;                                // Rows handed out so far, freed ones included
+        std::vector<uint32_t> freed;
+
+        uint32_t allocate(Reclaimer& reclaimer) {
+            if (!freed.empty()) {
+                uint32_t row = freed.back();
+                freed.pop_back();
+                return row;
+            }
+            name.grow(used + 1, reclaimer);
+            parent.grow(used + 1, reclaimer);
+            nextWithSameName.grow(used + 1, reclaimer);
+            removed.grow(used + 1, reclaimer);
+            return used++;
+        }
+
+        size_t size() const { return used - freed.size(); }
+
+        size_t getBytesReserved() const {
+            return name.getBytesReserved() + parent.getBytesReserved() + nextWithSameName.getBytesReserved() +
+                   removed.getBytesReserved();
+        }
+    };
+
+    // Files, then directories, so that the top bit of an id picks the rows
+    // without a branch
+    Rows rows[2];
+    Rows& files = rows[0];
+    Rows& directories = rows[1];
+    NodeColumn<DirectoryEntries> entries; // Indexed by directory row
+
+    static uint32_t row(NodeId node) { return node & ~DIRECTORY_BIT; }
+    Rows& rowsOf(NodeId node) { return rows[node >> 31]; }
+    const Rows& rowsOf(NodeId node) const { return rows[node >> 31]; }
+
+public:
+    static constexpr size_t FILE_ROW_BYTES = sizeof(NameId) + sizeof(NodeId) + sizeof(std::atomic<NodeId>) +
+                                             sizeof(std::atomic<bool>);
+    static constexpr size_t DIRECTORY_ROW_BYTES = FILE_ROW_BYTES + sizeof(DirectoryEntries);
+
+    NodeTable() {
+        // File row 0 is never handed out, so that no node's id is NO_NODE.
+        // Nobody can be reading a table under construction.
+        Reclaimer unshared;
+        files.allocate(unshared);
+    }
+
+    NodeTable(const NodeTable&) = delete;
+    NodeTable& operator=(const NodeTable&) = delete;
+
+    static bool isDirectory(NodeId node) { return (node & DIRECTORY_BIT) != 0; }
+    static NodeType type(NodeId node) { return isDirectory(node) ? NodeType::DIRECTORY : NodeType::FILE; }
+
+    NameId name(NodeId node) const { return rowsOf(node).name[row(node)]; }
+    // NO_NODE for the root
+    NodeId parent(NodeId node) const { return rowsOf(node).parent[row(node)]; }
+    std::atomic<NodeId>& nextWithSameName(NodeId node) const { return rowsOf(node).nextWithSameName[row(node)]; }
+    std::atomic<bool>& removed(NodeId node) const { return rowsOf(node).removed[row(node)]; }
+    DirectoryEntries& children(NodeId directory) const { return entries[row(directory)]; }
+
+    // Number of children; always 0 for files
+    size_t getChildCount(NodeId node) const { return isDirectory(node) ? children(node).size() : 0; }
+
+    // Prefetches the child index of a directory, the one part of a node a
+    // walk reads; does nothing for files
+    void prefetchChildren(NodeId node) const {
+        if (isDirectory(node)) {
+            prefetchForRead(&entries[row(node)]);
+        }
+    }
+
+    // Writer only: adds a node and returns its id. The caller links it into
+    // the name index. Storage that growth replaces goes to 'reclaimer'.
+    NodeId create(NameId name, NodeType type, NodeId parent, Reclaimer& reclaimer) {
+        Rows& kind = type == NodeType::DIRECTORY ? directories : files;
+        uint32_t row = kind.allocate(reclaimer);
+        if (type == NodeType::DIRECTORY) {
+            entries.grow(row + 1, reclaimer);
+        }
+        kind.name[row] = name;
+        kind.parent[row] = parent;
+        kind.nextWithSameName[row].store(NO_NODE, std::memory_order_relaxed);
+        kind.removed[row].store(false, std::memory_order_relaxed);
+        return type == NodeType::DIRECTORY ? row | DIRECTORY_BIT : row;
+    }
+
+    // Writer only: frees a node's row for reuse. Nothing may reach the node
+    // any more and a directory's children must have been released.
+    void destroy(NodeId node) {
+        rowsOf(node).freed.push_back(row(node));
+    }
+
+    size_t getFileCount() const { return files.size() - 1; }
+    size_t getDirectoryCount() const { return directories.size(); }
+
+    // Bytes of the rows in use
+    size_t getMemoryUsage() const {
+        return getFileCount() * FILE_ROW_BYTES + getDirectoryCount() * DIRECTORY_ROW_BYTES;
+    }
+
+    size_t getBytesReserved() const {
+        return files.getBytesReserved() + directories.getBytesReserved() + entries.getBytesReserved();
+    }
+};
+
+// Walks a tree without recursion, so a chain of a million directories is
+// no harder than a flat directory of a million files. Depth-first walks keep
+// one cursor per open directory on an explicit stack; breadth-first walks
+// keep a queue of directories. Visitors get each node's entry, its id and
+// name as stored in its parent, so a walk that only needs names never reads
+// the node table; directories a few steps ahead are prefetched, so the cache
+// misses of reaching their child indexes overlap with the work done on the
+// current node. Entries are read without locks: callers keep the tree alive
+// (a ReadSection) and, if they need it, stable.
+class TreeWalker {
+public:
+    using Entry = DirectoryEntries::Entry;
+
+    static constexpr size_t PREFETCH_DISTANCE = 4;
+
+    // Calls enter(entry, depth) before anything below a node and
+    // leave(entry, depth) after everything below it; 'start' is at depth 0.
+    // enter returns false to skip the node's children.
+    template <typename Enter, typename Leave>
+    static void depthFirst(const NodeTable& nodes, NodeId start, Enter&& enter, Leave&& leave) {
+        struct Frame {
+            Entry directory;
+            DirectoryEntries::const_iterator next;
+        };
+        std::vector<Frame> stack;
+        Entry first{nodes.name(start), start};
+        if (!enter(first, 0) || !NodeTable::isDirectory(start)) {
+            leave(first, 0);
+            return;
+        }
+        stack.push_back({first, nodes.children(start).view().begin()});
+        while (!stack.empty()) {
+            // Runs through the files of the innermost directory in a local
+            // cursor, stopping at the first subdirectory to descend into
+            size_t depth = stack.size();
+            DirectoryEntries::const_iterator next = stack.back().next;
+            Entry subdirectory{0, NO_NODE};
+            while (subdirectory.node == NO_NODE && !next.atEnd()) {
+                nodes.prefetchChildren(next.peek(PREFETCH_DISTANCE));
+                Entry child = *next++;
+                if (enter(child, depth) && NodeTable::isDirectory(child.node)) {
+                    subdirectory = child;
+                } else {
+                    leave(child, depth);
+                }
+            }
+            if (subdirectory.node != NO_NODE) {
+                stack.back().next = next;
+                stack.push_back({subdirectory, nodes.children(subdirectory.node).view().begin()});
+            } else {
+                Entry directory = stack.back().directory;
+                stack.pop_back();
+                leave(directory, stack.size());
+            }
+        }
+    }
+
+    // Calls visit(entry, depth) on each node before its children; visit
+    // returns false to skip them
+    template <typename Visit>
+    static void preOrder(const NodeTable& nodes, NodeId start, Visit&& visit) {
+        depthFirst(nodes, start, visit, [](const Entry&, size_t) {});
+    }
+
+    // Calls visit(entry, depth) on each node after its children
+    template <typename Visit>
+    static void postOrder(const NodeTable& nodes, NodeId start, Visit&& visit) {
+        depthFirst(nodes, start, [](const Entry&, size_t) { return true; }, visit);
+    }
+
+    // Calls visit(entry, depth) level by level, each directory's children
+    // in entry order; visit returns false to skip a node's children
+    template <typename Visit>
+    static void breadthFirst(const NodeTable& nodes, NodeId start, Visit&& visit) {
+        if (!visit(Entry{nodes.name(start), start}, 0) || !NodeTable::isDirectory(start)) {
+            return;
+        }
+        // Children are visited as their directory is read, so only the
+        // directories still to be read are queued
+        std::vector<NodeId> queue(1, start);
+        size_t depth = 1;    // Depth of the children being visited
+        size_t levelEnd = 1; // Where the directories of the next level start
+        for (size_t i = 0; i < queue.size(); ++i) {
+            if (i == levelEnd) {
+                ++depth;
+                levelEnd = queue.size();
+            }
+            if (i + PREFETCH_DISTANCE < queue.size()) {
+                nodes.prefetchChildren(queue[i + PREFETCH_DISTANCE]);
+            }
+            DirectoryEntries::View view = nodes.children(queue[i]).view();
+            for (auto next = view.begin(); !next.atEnd();) {
+                Entry child = *next++;
+                if (visit(child, depth) && NodeTable::isDirectory(child.node)) {
+                    queue.push_back(child.node);
+                }
+            }
+        }
+    }
+};
+
+// Walks the components of a '/'-separated path in place, without copying
+// them. Empty components produced by leading, trailing or repeated slashes
+// are skipped.
+class PathTokenizer {
+private:
+    std::string_view path;
+    size_t position = 0;
+
+public:
+    explicit PathTokenizer(std::string_view path) : path(path) {}
+
+    // Stores the next component and returns true, or returns false at the end
+    bool next(std::string_view& component) {
+        while (position < path.size() && path[position] == '/') {
+            ++position;
+        }
+        if (position == path.size()) {
+            return false;
+        }
+        size_t end = path.find('/', position);
+        if (end == std::string_view::npos) {
+            end = path.size();
+        }
+        component = path.substr(position, end - position);
+        position = end;
+        return true;
+    }
+};
+
+// Splits a command line into whitespace-separated words without copying
+class CommandTokenizer {
+private:
+    std::string_view line;
+    size_t position = 0;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+    }
+
+public:
+    explicit CommandTokenizer(std::string_view line) : line(line) {}
+
+    // Stores the next word and returns true, or returns false at the end
+    bool next(std::string_view& word) {
+        while (position < line.size() && isSpace(line[position])) {
+            ++position;
+        }
+        if (position == line.size()) {
+            return false;
+        }
+        size_t start = position;
+        while (position < line.size() && !isSpace(line[position])) {
+            ++position;
+        }
+        word = line.substr(start, position - start);
+        return true;
+    }
+};
+
+// How 'find' interprets its pattern
+enum class FindMode {
+    EXACT, // The whole name, compared literally
+    GLOB,  // Shell wildcards: '*', '?', '[a-z]', '[!abc]', '\' escapes
+    REGEX  // ECMAScript regular expression that must match the whole name
+};
+
+// A find pattern compiled once up front. Globs are classified when they are
+// parsed so the common shapes ('name', 'pre*', '*.ext', '*part*') are matched
+// with a plain string comparison; only other globs run the token matcher and
+// only -regex patterns use std::regex.
+class NameMatcher {
+public:
+    enum class Kind {
+        LITERAL,
+        PREFIX,
+        SUFFIX,
+        CONTAINS,
+        GLOB,
+        REGEX
+    };
+
+private:
+    struct GlobToken {
+        enum class Type { CHAR, ANY, STAR, CLASS } type;
+        char character;     // For CHAR
+        size_t classIndex;  // For CLASS, into 'classes'
+    };
+
+    Kind kind = Kind::LITERAL;
+    std::string literal; // For LITERAL, PREFIX, SUFFIX and CONTAINS
+    std::vector<GlobToken> tokens;
+    std::vector<std::bitset<256>> classes;
+    std::regex regex;
+
+    // Parses a '[...]' class starting at pattern[start]; returns false if it
+    // is not terminated, in which case '[' is taken literally
+    bool parseClass(const std::string& pattern, size_t start, size_t& end) {
+        size_t i = start + 1;
+        bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+        if (negate) {
+            ++i;
+        }
+        std::bitset<256> set;
+        bool first = true;
+        while (i < pattern.size() && (pattern[i] != ']' || first)) {
+            unsigned char low = static_cast<unsigned char>(pattern[i]);
+            if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+                unsigned char high = static_cast<unsigned char>(pattern[i + 2]);
+                for (unsigned c = low; c <= high; ++c) {
+                    set.set(c);
+                }
+                i += 3;
+            } else {
+                set.set(low);
+                ++i;
+            }
+            first = false;
+        }
+        if (i >= pattern.size()) {
+            return false;
+        }
+        classes.push_back(negate ? ~set : set);
+        end = i + 1;
+        return true;
+    }
+
+    bool tokenMatches(const GlobToken& token, char c) const {
+        switch (token.type) {
+            case GlobToken::Type::CHAR:
+                return token.character == c;
+            case GlobToken::Type::ANY:
+                return true;
+            case GlobToken::Type::CLASS:
+                return classes[token.classIndex].test(static_cast<unsigned char>(c));
+            default:
+                return false;
+        }
+    }
+
+    // Wildcard matching with single-star backtracking: on a mismatch, retry
+    // from the most recent '*' consuming one more character. O(n*m) worst case.
+    bool globMatches(std::string_view name) const {
+        size_t t = 0, n = 0;
+        size_t starToken = SIZE_MAX, starName = 0;
+        while (n < name.size()) {
+            if (t < tokens.size() && tokens[t].type == GlobToken::Type::STAR) {
+                starToken = ++t;
+                starName = n;
+            } else if (t < tokens.size() && tokenMatches(tokens[t], name[n])) {
+                ++t;
+                ++n;
+            } else if (starToken != SIZE_MAX) {
+                t = starToken;
+                n = ++starName;
+            } else {
+                return false;
+            }
+        }
+        while (t < tokens.size() && tokens[t].type == GlobToken::Type::STAR) {
+            ++t;
+        }
+        return t == tokens.size();
+    }
+
+    void compileGlob(const std::string& pattern) {
+        for (size_t i = 0; i < pattern.size();) {
+            char c = pattern[i];
+            size_t end;
+            if (c == '*') {
+                if (tokens.empty() || tokens.back().type != GlobToken::Type::STAR) {
+                    tokens.push_back({GlobToken::Type::STAR, 0, 0});
+                }
+                ++i;
+            } else if (c == '?') {
+                tokens.push_back({GlobToken::Type::ANY, 0, 0});
+                ++i;
+            } else if (c == '[' && parseClass(pattern, i, end)) {
+                tokens.push_back({GlobToken::Type::CLASS, 0, classes.size() - 1});
+                i = end;
+            } else if (c == '\\' && i + 1 < pattern.size()) {
+                tokens.push_back({GlobToken::Type::CHAR, pattern[i + 1], 0});
+                i += 2;
+            } else {
+                tokens.push_back({GlobToken::Type::CHAR, c, 0});
+                ++i;
+            }
+        }
+
+        // Classify: only literal characters, optionally wrapped in stars
+        bool leadingStar = !tokens.empty() && tokens.front().type == GlobToken::Type::STAR;
+        bool trailingStar = tokens.size() > (leadingStar ? 1u : 0u) && tokens.back().type == GlobToken::Type::STAR;
+        size_t first = leadingStar ? 1 : 0;
+        size_t last = tokens.size() - (trailingStar ? 1 : 0);
+        for (size_t i = first; i < last; ++i) {
+            if (tokens[i].type != GlobToken::Type::CHAR) {
+                kind = Kind::GLOB;
+                return;
+            }
+            literal += tokens[i].character;
+        }
+        if (leadingStar && trailingStar) {
+            kind = Kind::CONTAINS;
+        } else if (leadingStar) {
+            kind = Kind::SUFFIX;
+        } else if (trailingStar) {
+            kind = Kind::PREFIX;
+        } else {
+            kind = Kind::LITERAL;
+        }
+        tokens.clear();
+    }
+
+public:
+    // Throws std::regex_error if a REGEX pattern does not compile
+    NameMatcher(const std::string& pattern, FindMode mode) {
+        if (mode == FindMode::EXACT) {
+            literal = pattern;
+        } else if (mode == FindMode::GLOB) {
+            compileGlob(pattern);
+        } else {
+            kind = Kind::REGEX;
+            regex = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+        }
+    }
+
+    Kind getKind() const { return kind; }
+    const std::string& getLiteral() const { return literal; }
+
+    bool matches(std::string_view name) const {
+        switch (kind) {
+            case Kind::LITERAL:
+                return name == literal;
+            case Kind::PREFIX:
+                return name.size() >= literal.size() && name.compare(0, literal.size(), literal) == 0;
+            case Kind::SUFFIX:
+                return name.size() >= literal.size() &&
+                       name.compare(name.size() - literal.size(), literal.size(), literal) == 0;
+            case Kind::CONTAINS:
+                return name.find(literal) != std::string_view::npos;
+            case Kind::GLOB:
+                return globMatches(name);
+            default:
+                return std::regex_match(name.begin(), name.end(), regex);
+        }
+    }
+};
+
+// Runs a dynamically growing set of tasks on a fixed number of threads.
+// Each worker owns a deque: it pushes and pops new work at the back (depth
+// first, cache warm) while idle workers steal from the front of the others'
+// deques, where the oldest and usually largest pieces of work sit.
+template <typename Task>
+class WorkStealingScheduler {
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<WorkerQueue> queues;
+    std::atomic<size_t> pendingTasks{0}; // Queued or currently running
+
+    bool popLocal(size_t worker, Task& task) {
+        WorkerQueue& queue = queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t worker, Task& task) {
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            WorkerQueue& victim = queues[(worker + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    explicit WorkStealingScheduler(size_t threadCount) : queues(threadCount == 0 ? 1 : threadCount) {}
+
+    size_t getThreadCount() const { return queues.size(); }
+
+    // Queues a task on the given worker's deque (callable from inside a task)
+    void push(size_t worker, Task task) {
+        pendingTasks.fetch_add(1, std::memory_order_relaxed);
+        WorkerQueue& queue = queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Runs 'process(task, worker)' for every queued task, and every task
+    // those spawn through push(), returning once all of them have finished
+    template <typename Process>
+    void run(Process process) {
+        auto workerLoop = [this, &process](size_t worker) {
+            Task task;
+            while (pendingTasks.load(std::memory_order_acquire) != 0) {
+                if (popLocal(worker, task) || steal(worker, task)) {
+                    process(task, worker);
+                    pendingTasks.fetch_sub(1, std::memory_order_acq_rel);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t worker = 1; worker < queues.size(); ++worker) {
+            threads.emplace_back(workerLoop, worker);
+        }
+        workerLoop(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+// Read-only view of a whole file. Memory-mapped where the platform supports
+// it, so pages are only faulted in as they are touched; read into a buffer
+// otherwise.
+class MappedFile {
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    std::vector<char> buffer;
+#else
+    void* mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        std::ifstream in(path, std::ios::binary);
+        if (in) {
+            buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            data = buffer.data();
+            length = buffer.size();
+            if (length == 0) {
+                data = "";
+            }
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) == 0) {
+            length = static_cast<size_t>(info.st_size);
+            if (length == 0) {
+                data = "";
+            } else {
+                mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED) {
+                    data = static_cast<const char*>(mapping);
+                } else {
+                    mapping = nullptr;
+                    length = 0;
+                }
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapping != nullptr) {
+            ::munmap(mapping, length);
+        }
+#endif
+    }
+
+    bool isOpen() const { return data != nullptr; }
+    const char* getData() const { return data; }
+    size_t size() const { return length; }
+};
+
+// One entry read from a host directory; the name lives in a shared buffer
+struct HostEntry {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    bool directory;
+};
+
+// A directory on the host file system, opened for 'import'. On Linux it is
+// opened relative to its parent with openat() and listed with raw
+// getdents64() calls into a large buffer, which avoids both full path
+// lookups and the per-entry overhead of readdir(); elsewhere it falls back
+// to std::filesystem. Symbolic links are listed as files, never followed.
+class HostDirectory {
+private:
+#ifdef __linux__
+    int fd = -1;
+
+    explicit HostDirectory(int fd) : fd(fd) {}
+#else
+    std::filesystem::path path;
+
+    explicit HostDirectory(std::filesystem::path path) : path(std::move(path)) {}
+#endif
+
+public:
+    HostDirectory(const HostDirectory&) = delete;
+    HostDirectory& operator=(const HostDirectory&) = delete;
+
+    ~HostDirectory() {
+#ifdef __linux__
+        ::close(fd);
+#endif
+    }
+
+    // Opens a directory by path; returns nullptr if it cannot be opened
+    static std::unique_ptr<HostDirectory> open(const std::string& path) {
+#ifdef __linux__
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        return fd < 0 ? nullptr : std::unique_ptr<HostDirectory>(new HostDirectory(fd));
+#else
+        std::error_code error;
+        if (!std::filesystem::is_directory(path, error)) {
+            return nullptr;
+        }
+        return std::unique_ptr<HostDirectory>(new HostDirectory(path));
+#endif
+    }
+
+    // Opens a subdirectory by name; returns nullptr if it cannot be opened
+    std::unique_ptr<HostDirectory> openChild(const std::string& name) const {
+#ifdef __linux__
+        int child = ::openat(fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        return child < 0 ? nullptr : std::unique_ptr<HostDirectory>(new HostDirectory(child));
+#else
+        return open((path / name).string());
+#endif
+    }
+
+    // Appends every entry except '.' and '..' to 'entries', with the names
+    // packed into 'names'; returns false if the directory cannot be read
+    bool read(std::string& names, std::vector<HostEntry>& entries) const {
+        auto add = [&](std::string_view name, bool directory) {
+            if (name == "." || name == "..") {
+                return;
+            }
+            entries.push_back({static_cast<uint32_t>(names.size()), static_cast<uint32_t>(name.size()), directory});
+            names.append(name);
+        };
+#ifdef __linux__
+        // Layout of the records getdents64 fills in: d_ino (8 bytes),
+        // d_off (8), d_reclen (2), d_type (1), then the NUL-terminated name
+        constexpr size_t RECORD_LENGTH_OFFSET = 16;
+        constexpr size_t TYPE_OFFSET = 18;
+        constexpr size_t NAME_OFFSET = 19;
+        alignas(8) char buffer[1 << 15];
+        while (true) {
+            long bytes = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+            if (bytes < 0) {
+                return false;
+            }
+            if (bytes == 0) {
+                return true;
+            }
+            for (long position = 0; position < bytes;) {
+                const char* record = buffer + position;
+                unsigned short recordLength;
+                std::memcpy(&recordLength, record + RECORD_LENGTH_OFFSET, sizeof(recordLength));
+                unsigned char type = static_cast<unsigned char>(record[TYPE_OFFSET]);
+                const char* name = record + NAME_OFFSET;
+                bool directory = type == DT_DIR;
+                if (type == DT_UNKNOWN) {
+                    // Some file systems do not report types in the listing
+                    struct stat info;
+                    directory = ::fstatat(fd, name, &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode);
+                }
+                add(name, directory);
+                position += recordLength;
+            }
+        }
+#else
+        std::error_code error;
+        std::filesystem::directory_iterator it(path, error), end;
+        for (; !error && it != end; it.increment(error)) {
+            std::string name = it->path().filename().string();
+            std::error_code typeError;
+            add(name, it->is_directory(typeError) && !it->is_symlink(typeError));
+        }
+        return !error;
+#endif
+    }
+};
+
+// Appends text to a JSON string body, escaping quotes, backslashes and
+// control characters. Other bytes are copied as they are, so names that are
+// not valid UTF-8 produce output that is not strictly valid JSON.
+inline void appendJsonEscaped(std::string& out, std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    size_t clean = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(text.data() + clean, i - clean);
+        clean = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += HEX[c >> 4];
+                out += HEX[c & 0xF];
+                break;
+        }
+    }
+    out.append(text.data() + clean, text.size() - clean);
+}
+
+// Forces a file's contents to stable storage
+inline bool syncFile(FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return ::fsync(fileno(file)) == 0;
+#endif
+}
+
+// Cuts an open file down to 'size' bytes
+inline bool truncateFile(FILE* file, uint64_t size) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+#else
+    return ::ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+// Makes the entries of a directory, such as a file just renamed into it,
+// durable
+inline bool syncDirectory(const std::string& directory) {
+#ifdef _WIN32
+    (void)directory; // NTFS commits renames with its own metadata journal
+    return true;
+#else
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
+
+// Append-only log of tree mutations for crash recovery. Each record is
+//   [u32 path length][u8 operation][path bytes][u32 checksum]
+// in native byte order, where the checksum covers the operation and path so
+// that a torn write at the tail is detected on replay. Appends only go to
+// an in-memory buffer, which is written and fsynced once COMMIT_INTERVAL has
+// passed or when the owner calls commit(), so a burst of mutations shares
+// one fsync (group commit). This runs on the caller's thread on purpose: a
+// background committer would make every stdio call in the REPL take locks.
+class Journal {
+public:
+    enum class Operation : uint8_t {
+        MKDIR = 1,
+        TOUCH = 2,
+        REMOVE = 3 // Removes the node and everything below it
+    };
+
+    static constexpr std::chrono::milliseconds COMMIT_INTERVAL{20};
+
+private:
+    FILE* file = nullptr;
+    std::string path;
+    std::string pending;
+    std::string error;                // Why the last commit failed; empty once one succeeds
+    uint64_t committedSize = 0;       // Bytes of the file that hold whole, synced records
+    size_t recordCount = 0;           // Records since the journal was last reset
+    std::chrono::steady_clock::time_point lastCommit;
+
+    static uint32_t checksum(uint8_t operation, std::string_view path) {
+        uint32_t hash = 2166136261u;
+        hash = (hash ^ operation) * 16777619u;
+        for (char c : path) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+public:
+    explicit Journal(const std::string& path) : path(path) {
+        file = std::fopen(path.c_str(), "ab");
+        if (file != nullptr) {
+            // Records are batched in 'pending' already; unbuffered, a failed
+            // commit leaves nothing behind in stdio to be written later
+            std::setvbuf(file, nullptr, _IONBF, 0);
+            std::fseek(file, 0, SEEK_END);
+            committedSize = static_cast<uint64_t>(std::max<long>(std::ftell(file), 0));
+        }
+        lastCommit = std::chrono::steady_clock::now();
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() {
+        if (file != nullptr) {
+            if (!commit()) {
+                std::cerr << "Error: Cannot write journal '" << path << "': " << error << '\n';
+            }
+            std::fclose(file);
+        }
+    }
+
+    bool isOpen() const { return file != nullptr; }
+    bool hasPending() const { return !pending.empty(); }
+    size_t getRecordCount() const { return recordCount; }
+    const std::string& getError() const { return error; }
+
+    void append(Operation operation, std::string_view nodePath) {
+        uint32_t length = static_cast<uint32_t>(nodePath.size());
+        uint8_t op = static_cast<uint8_t>(operation);
+        uint32_t sum = checksum(op, nodePath);
+        pending.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        pending.append(reinterpret_cast<const char*>(&op), sizeof(op));
+        pending.append(nodePath);
+        pending.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+        ++recordCount;
+        if (std::chrono::steady_clock::now() - lastCommit >= COMMIT_INTERVAL) {
+            commit();
+        }
+    }
+
+    // Makes every record appended so far durable before returning. If they
+    // cannot be written and synced (a full disk, say), returns false and
+    // keeps them for the next attempt; getError says why.
+    bool commit() {
+        lastCommit = std::chrono::steady_clock::now();
+        if (pending.empty()) {
+            return true;
+        }
+        if (std::fwrite(pending.data(), 1, pending.size(), file) != pending.size() || !syncFile(file)) {
+            error = std::strerror(errno);
+            // Drop whatever part of the batch did reach the file, or the
+            // retry would follow a torn record that ends replay
+            std::clearerr(file);
+            truncateFile(file, committedSize);
+            return false;
+        }
+        committedSize += pending.size();
+        pending.clear();
+        error.clear();
+        return true;
+    }
+
+    // Empties the journal once its contents are covered by a snapshot.
+    // Returns false with the reason in 'failure' if the file could not be
+    // cut; its records are then replayed again after a restart, which only
+    // repeats changes already in the snapshot.
+    bool reset(std::string& failure) {
+        pending.clear();
+        error.clear();
+        recordCount = 0;
+        if (!truncateFile(file, 0)) {
+            failure = std::strerror(errno);
+            return false;
+        }
+        committedSize = 0;
+        if (!syncFile(file)) {
+            failure = std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // Calls apply(operation, path) for each intact record in a journal image
+    // and returns the length of the intact prefix; anything after it is a
+    // torn or corrupt tail
+    template <typename Apply>
+    static size_t replay(const char* data, size_t size, Apply apply) {
+        size_t position = 0;
+        const size_t overhead = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t);
+        while (size - position >= overhead) {
+            uint32_t length;
+            std::memcpy(&length, data + position, sizeof(length));
+            if (length > size - position - overhead) {
+                break;
+            }
+            uint8_t op = static_cast<uint8_t>(data[position + sizeof(length)]);
+            std::string_view nodePath(data + position + sizeof(length) + sizeof(op), length);
+            uint32_t sum;
+            std::memcpy(&sum, nodePath.data() + length, sizeof(sum));
+            if (sum != checksum(op, nodePath) || op < static_cast<uint8_t>(Operation::MKDIR) ||
+                op > static_cast<uint8_t>(Operation::REMOVE)) {
+                break;
+            }
+            apply(static_cast<Operation>(op), nodePath);
+            position += overhead + length;
+        }
+        return position;
+    }
+};
+
+// Reader/writer spin lock in a single word, usable with std::shared_lock
+// and std::lock_guard. It is padded to a cache line so that neighbouring
+// locks in an array do not contend for the same line. Taking it uncontended
+// costs one atomic add, which matters on paths that take several of them;
+// std::shared_mutex costs several times that. A waiting writer turns new
+// readers away, so a stream of readers cannot starve it. Waiters yield
+// rather than spin, since the holder may need the waiter's core to finish.
+class alignas(64) ReadWriteLock {
+private:
+    static constexpr uint32_t WRITER = 1u << 31;
+    std::atomic<uint32_t> state{0}; // WRITER bit plus the number of readers
+
+public:
+    void lock_shared() {
+        while (state.fetch_add(1, std::memory_order_acquire) & WRITER) {
+            state.fetch_sub(1, std::memory_order_relaxed);
+            while (state.load(std::memory_order_relaxed) & WRITER) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock_shared() { state.fetch_sub(1, std::memory_order_release); }
+
+    void lock() {
+        uint32_t expected = state.load(std::memory_order_relaxed);
+        while ((expected & WRITER) != 0 ||
+               !state.compare_exchange_weak(expected, expected | WRITER, std::memory_order_acquire)) {
+            if (expected & WRITER) {
+                std::this_thread::yield();
+                expected = state.load(std::memory_order_relaxed);
+            }
+        }
+        // New readers now back off; wait for the ones already inside
+        while (state.load(std::memory_order_acquire) != WRITER) {
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock() { state.fetch_and(~WRITER, std::memory_order_release); }
+};
+
+// Number of set bits in a word
+inline unsigned popcount64(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcountll(word));
+#else
+    unsigned count = 0;
+    for (; word != 0; word &= word - 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Position of the lowest set bit of a word that is not 0
+inline unsigned lowestBit64(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#else
+    unsigned position = 0;
+    for (; (word & 1) == 0; word >>= 1) {
+        ++position;
+    }
+    return position;
+#endif
+}
+
+// Up to 8 bytes of a name from 'offset' on, as a number that orders like
+// the names do
+inline uint64_t nameKey(std::string_view name, size_t offset = 0) {
+    uint64_t key = 0;
+    for (size_t i = offset; i < offset + 8; ++i) {
+        key = key << 8 | (i < name.size() ? static_cast<unsigned char>(name[i]) : 0);
+    }
+    return key;
+}
+
+// A bit string with rank (how many ones come before a position) and select
+// (where the k-th one or zero is), for the shape of a FrozenTree. The number
+// of ones before every 512-bit block is kept, 6% on top of the bits, so rank
+// counts at most 7 words; the block of every 512th one and zero is kept as
+// well, so select only searches the blocks between two samples.
+class RankSelectBits {
+private:
+    static constexpr size_t BLOCK_WORDS = 8;
+    static constexpr size_t BLOCK_BITS = BLOCK_WORDS * 64;
+    static constexpr size_t SELECT_SAMPLE = 512;
+
+    std::vector<uint64_t> words;
+    std::vector<uint32_t> blockRanks;  // Ones before each block, then the total
+    std::vector<uint32_t> oneSamples;  // Block of every SELECT_SAMPLE-th one
+    std::vector<uint32_t> zeroSamples; // Block of every SELECT_SAMPLE-th zero
+    size_t bitCount = 0;
+
+    size_t before(size_t block, bool ones) const {
+        return ones ? blockRanks[block] : block * BLOCK_BITS - blockRanks[block];
+    }
+
+    // Records the block of every sampled bit among 'count' more matching
+    // bits, 'seen' of them having come before
+    static void sample(std::vector<uint32_t>& samples, size_t seen, size_t count, size_t block) {
+        for (size_t next = (seen + SELECT_SAMPLE - 1) / SELECT_SAMPLE * SELECT_SAMPLE; next < seen + count;
+             next += SELECT_SAMPLE) {
+            samples.push_back(static_cast<uint32_t>(block));
+        }
+    }
+
+    size_t select(size_t k, bool ones) const {
+        // The bit is in the last block with at most k matching bits before it
+        const std::vector<uint32_t>& samples = ones ? oneSamples : zeroSamples;
+        size_t sampled = k / SELECT_SAMPLE;
+        size_t low = samples[sampled];
+        size_t high = sampled + 1 < samples.size() ? samples[sampled + 1] + 1 : blockRanks.size() - 1;
+        while (high - low > 1) {
+            size_t middle = (low + high) / 2;
+            if (before(middle, ones) <= k) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        size_t remaining = k - before(low, ones);
+        for (size_t w = low * BLOCK_WORDS;; ++w) {
+            uint64_t word = ones ? words[w] : ~words[w];
+            size_t count = popcount64(word);
+            if (remaining < count) {
+                for (; remaining != 0; --remaining) {
+                    word &= word - 1;
+                }
+                return w * 64 + lowestBit64(word);
+            }
+            remaining -= count;
+        }
+    }
+
+public:
+    void push(bool bit) {
+        if (bitCount % 64 == 0) {
+            words.push_back(0);
+        }
+        words.back() |= uint64_t(bit) << (bitCount % 64);
+        ++bitCount;
+    }
+
+    // Builds the rank and select samples; called once after the last push
+    void finish() {
+        size_t blocks = (words.size() + BLOCK_WORDS - 1) / BLOCK_WORDS;
+        blockRanks.assign(blocks + 1, 0);
+        size_t ones = 0;
+        size_t zeros = 0;
+        for (size_t w = 0; w < words.size(); ++w) {
+            if (w % BLOCK_WORDS == 0) {
+                blockRanks[w / BLOCK_WORDS] = static_cast<uint32_t>(ones);
+            }
+            size_t count = popcount64(words[w]);
+            size_t valid = std::min<size_t>(64, bitCount - w * 64);
+            sample(oneSamples, ones, count, w / BLOCK_WORDS);
+            sample(zeroSamples, zeros, valid - count, w / BLOCK_WORDS);
+            ones += count;
+            zeros += valid - count;
+        }
+        blockRanks[blocks] = static_cast<uint32_t>(ones);
+    }
+
+    size_t size() const { return bitCount; }
+
+    // Ones before 'position'
+    size_t rank1(size_t position) const {
+        size_t rank = blockRanks[position / BLOCK_BITS];
+        for (size_t w = position / BLOCK_BITS * BLOCK_WORDS; w < position / 64; ++w) {
+            rank += popcount64(words[w]);
+        }
+        if (position % 64 != 0) {
+            rank += popcount64(words[position / 64] & ((uint64_t(1) << (position % 64)) - 1));
+        }
+        return rank;
+    }
+
+    // Zeros before 'position'
+    size_t rank0(size_t position) const { return position - rank1(position); }
+
+    // Position of the k-th one, counting from 0; there must be one
+    size_t select1(size_t k) const { return select(k, true); }
+
+    // Position of the k-th zero, counting from 0; there must be one
+    size_t select0(size_t k) const { return select(k, false); }
+
+    // Position of the first zero at or after 'position'; there must be one
+    size_t nextZero(size_t position) const {
+        size_t w = position / 64;
+        uint64_t zeros = ~words[w] >> (position % 64) << (position % 64);
+        while (zeros == 0) {
+            zeros = ~words[++w];
+        }
+        return w * 64 + lowestBit64(zeros);
+    }
+
+    size_t getMemoryUsage() const {
+        return words.size() * sizeof(uint64_t) +
+               (blockRanks.size() + oneSamples.size() + zeroSamples.size()) * sizeof(uint32_t);
+    }
+};
+
+// Unsigned integers of one fixed bit width, packed back to back
+class PackedInts {
+private:
+    std::vector<uint64_t> words;
+    unsigned width;
+    uint64_t mask;
+    size_t count = 0;
+
+public:
+    // Room for values up to 'largest'
+    explicit PackedInts(uint64_t largest = 1) : width(1) {
+        while (width < 64 && (largest >> width) != 0) {
+            ++width;
+        }
+        mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    }
+
+    void push(uint64_t value) {
+        size_t bit = count * width;
+        words.resize((bit + width + 63) / 64);
+        words[bit / 64] |= value << (bit % 64);
+        if (bit % 64 + width > 64) {
+            words[bit / 64 + 1] |= value >> (64 - bit % 64);
+        }
+        ++count;
+    }
+
+    uint64_t get(size_t index) const {
+        size_t bit = index * width;
+        uint64_t value = words[bit / 64] >> (bit % 64);
+        if (bit % 64 + width > 64) {
+            value |= words[bit / 64 + 1] << (64 - bit % 64);
+        }
+        return value & mask;
+    }
+
+    size_t size() const { return count; }
+    unsigned getWidth() const { return width; }
+    size_t getMemoryUsage() const { return words.size() * sizeof(uint64_t); }
+};
+
+// A sorted set of distinct names, front coded: in every bucket of
+// BUCKET_SIZE names the first is kept whole and each of the others as the
+// length of the prefix it shares with the one before, then the rest. Sorted
+// names share long prefixes, so this is a fraction of the size of the names
+// themselves. A name's id is its position in sorted order.
+class FrontCodedNames {
+private:
+    static constexpr size_t BUCKET_SIZE = 16;
+
+    std::string data;
+    std::vector<uint32_t> bucketStarts;
+    // The first 8 bytes of each bucket's first name, as a number that
+    // orders like the names do, so lookups search a small dense array
+    std::vector<uint64_t> bucketKeys;
+    size_t count = 0;
+    size_t characters = 0;
+
+    static void putNumber(std::string& out, size_t value) {
+        for (; value >= 0x80; value >>= 7) {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+        }
+        out += static_cast<char>(value);
+    }
+
+    static size_t getNumber(const char*& cursor) {
+        size_t value = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            unsigned char byte = static_cast<unsigned char>(*cursor++);
+            value |= size_t(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+    }
+
+    // The name a bucket starts with, and where the rest of the bucket starts
+    std::string_view first(size_t bucket, const char*& cursor) const {
+        cursor = data.data() + bucketStarts[bucket];
+        size_t length = getNumber(cursor);
+        std::string_view name(cursor, length);
+        cursor += length;
+        return name;
+    }
+
+    // Turns 'name', the name before, into the next one in its bucket
+    static void next(const char*& cursor, std::string& name) {
+        size_t shared = getNumber(cursor);
+        size_t rest = getNumber(cursor);
+        name.resize(shared);
+        name.append(cursor, rest);
+        cursor += rest;
+    }
+
+public:
+    FrontCodedNames() = default;
+
+    // 'sorted' must be in order and hold no name twice
+    explicit FrontCodedNames(const std::vector<std::string_view>& sorted) : count(sorted.size()) {
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            characters += sorted[i].size();
+            if (i % BUCKET_SIZE == 0) {
+                bucketStarts.push_back(static_cast<uint32_t>(data.size()));
+                bucketKeys.push_back(nameKey(sorted[i]));
+                putNumber(data, sorted[i].size());
+                data += sorted[i];
+                continue;
+            }
+            size_t shared = 0;
+            while (shared < sorted[i].size() && shared < sorted[i - 1].size() &&
+                   sorted[i][shared] == sorted[i - 1][shared]) {
+                ++shared;
+            }
+            putNumber(data, shared);
+            putNumber(data, sorted[i].size() - shared);
+            data += sorted[i].substr(shared);
+        }
+        data.shrink_to_fit();
+    }
+
+    size_t size() const { return count; }
+    size_t getCharacterBytes() const { return characters; }
+
+    // Stores the name with the given id in 'name'
+    void get(uint32_t id, std::string& name) const {
+        const char* cursor;
+        name = first(id / BUCKET_SIZE, cursor);
+        for (size_t i = id % BUCKET_SIZE; i != 0; --i) {
+            next(cursor, name);
+        }
+    }
+
+    // Finds the id of a name; returns false if the set does not hold it
+    bool lookup(std::string_view name, uint32_t& id) const {
+        if (count == 0) {
+            return false;
+        }
+        // Binary search for the last bucket starting at or before the name,
+        // then a scan of that bucket. Keys that differ decide on their own.
+        const char* cursor;
+        uint64_t key = nameKey(name);
+        size_t low = 0;
+        size_t high = bucketStarts.size();
+        while (high - low > 1) {
+            size_t middle = (low + high) / 2;
+            if (bucketKeys[middle] != key ? bucketKeys[middle] < key : first(middle, cursor) <= name) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        // Each name in the bucket is compared only from the characters it
+        // shares with the one before onwards: a name sharing more of them
+        // than the last one shared with 'name' is still before it, and one
+        // sharing fewer is already past it
+        auto commonPrefix = [](std::string_view a, std::string_view b) {
+            size_t length = 0;
+            while (length < a.size() && length < b.size() && a[length] == b[length]) {
+                ++length;
+            }
+            return length;
+        };
+        std::string_view candidate = first(low, cursor);
+        size_t matched = 0;
+        size_t last = std::min(count, (low + 1) * BUCKET_SIZE);
+        for (size_t i = low * BUCKET_SIZE;; ) {
+            size_t more = commonPrefix(candidate, name.substr(matched));
+            matched += more;
+            if (more == candidate.size() && matched == name.size()) {
+                id = static_cast<uint32_t>(i);
+                return true;
+            }
+            if (more != candidate.size() &&
+                (matched == name.size() || static_cast<unsigned char>(candidate[more]) >
+                                               static_cast<unsigned char>(name[matched]))) {
+                return false;
+            }
+            size_t shared;
+            do {
+                if (++i == last) {
+                    return false;
+                }
+                shared = getNumber(cursor);
+                size_t rest = getNumber(cursor);
+                candidate = std::string_view(cursor, rest);
+                cursor += rest;
+            } while (shared > matched);
+            if (shared < matched) {
+                return false;
+            }
+        }
+    }
+
+    // Calls visit(id, name) for every name, in order
+    template <typename Visit>
+    void forEach(Visit&& visit) const {
+        std::string name;
+        const char* cursor = nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            if (i % BUCKET_SIZE == 0) {
+                name = first(i / BUCKET_SIZE, cursor);
+            } else {
+                next(cursor, name);
+            }
+            visit(static_cast<uint32_t>(i), std::string_view(name));
+        }
+    }
+
+    size_t getMemoryUsage() const {
+        return data.capacity() + bucketStarts.size() * sizeof(uint32_t) + bucketKeys.size() * sizeof(uint64_t);
+    }
+};
+
+// A tree that can no longer change, kept in a few bytes per node (freeze).
+// Nodes are numbered breadth-first with each directory's children in name
+// order, so the children of a node have consecutive numbers and the shape of
+// the tree is one LOUDS bit string: "10" for the root, then for every node
+// in order a 1 per child and a 0. The children of node x are numbered from
+// select0(x) - x, there are select0(x + 1) - select0(x) - 1 of them, and the
+// parent of x is rank0(select1(x)) - 1. Besides those two bits each node
+// has a bit saying whether it is a directory and the id of its name in a
+// front-coded table of the distinct names, packed into as few bits as the
+// ids need. Name ids follow name order, so a directory's children are found
+// by binary search and listed already sorted.
+class FrozenTree {
+public:
+    static constexpr uint32_t ROOT = 0;
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+private:
+    RankSelectBits shape;
+    std::vector<uint64_t> directoryBits;
+    size_t directoryCount = 0;
+    PackedInts nameIds;
+    FrontCodedNames names;
+
+public:
+    // Copies the tree below 'root'; the caller keeps it from changing
+    // meanwhile
+    FrozenTree(const NodeTable& nodes, NodeId root, const NameTable& nameTable) {
+        // Every interned name's place in name order, so that siblings can be
+        // sorted by comparing numbers. Names are sorted by 8 bytes at a time,
+        // only runs that tie going on to the next 8, so that most comparisons
+        // touch no string.
+        std::vector<std::pair<uint64_t, NameId>> keyed(nameTable.size());
+        for (NameId id = 0; id < keyed.size(); ++id) {
+            keyed[id] = {nameKey(nameTable.get(id)), id};
+        }
+        struct Run {
+            size_t begin;
+            size_t end;
+            size_t offset;
+        };
+        std::vector<Run> runs{{0, keyed.size(), 0}};
+        while (!runs.empty()) {
+            Run run = runs.back();
+            runs.pop_back();
+            std::sort(keyed.begin() + run.begin, keyed.begin() + run.end);
+            for (size_t tie = run.begin, next; tie < run.end; tie = next) {
+                bool longer = false;
+                for (next = tie; next < run.end && keyed[next].first == keyed[tie].first; ++next) {
+                    longer |= nameTable.get(keyed[next].second).size() > run.offset + 8;
+                }
+                if (next - tie > 1 && longer) {
+                    for (size_t i = tie; i < next; ++i) {
+                        keyed[i].first = nameKey(nameTable.get(keyed[i].second), run.offset + 8);
+                    }
+                    runs.push_back({tie, next, run.offset + 8});
+                }
+            }
+        }
+        std::vector<NameId> byName(keyed.size());
+        std::vector<uint32_t> nameOrder(keyed.size());
+        for (size_t i = 0; i < keyed.size(); ++i) {
+            byName[i] = keyed[i].second;
+            nameOrder[keyed[i].second] = static_cast<uint32_t>(i);
+        }
+        keyed = {};
+
+        // Breadth-first, writing the shape as each node's children are
+        // queued
+        std::vector<NodeId> order(1, root);
+        std::vector<bool> used(byName.size());
+        std::vector<std::pair<uint32_t, NodeId>> siblings;
+        shape.push(true);
+        shape.push(false);
+        for (size_t i = 0; i < order.size(); ++i) {
+            NodeId node = order[i];
+            used[nodes.name(node)] = true;
+            siblings.clear();
+            if (NodeTable::isDirectory(node)) {
+                for (const auto& entry : nodes.children(node).view()) {
+                    siblings.emplace_back(nameOrder[entry.name], entry.node);
+                }
+                std::sort(siblings.begin(), siblings.end());
+            }
+            for (const auto& sibling : siblings) {
+                order.push_back(sibling.second);
+                shape.push(true);
+            }
+            shape.push(false);
+        }
+        shape.finish();
+
+        // Only names still in use are kept; their ids are renumbered densely
+        std::vector<std::string_view> sorted;
+        std::vector<uint32_t> frozenIds(byName.size());
+        for (NameId id : byName) {
+            if (used[id]) {
+                frozenIds[id] = static_cast<uint32_t>(sorted.size());
+                sorted.push_back(nameTable.get(id));
+            }
+        }
+        names = FrontCodedNames(sorted);
+        nameIds = PackedInts(sorted.size() - 1);
+        directoryBits.assign((order.size() + 63) / 64, 0);
+        for (size_t i = 0; i < order.size(); ++i) {
+            nameIds.push(frozenIds[nodes.name(order[i])]);
+            if (NodeTable::isDirectory(order[i])) {
+                directoryBits[i / 64] |= uint64_t(1) << (i % 64);
+                ++directoryCount;
+            }
+        }
+    }
+
+    size_t size() const { return nameIds.size(); }
+    size_t getDirectoryCount() const { return directoryCount; }
+    const FrontCodedNames& getNames() const { return names; }
+
+    bool isDirectory(uint32_t node) const { return (directoryBits[node / 64] >> (node % 64)) & 1; }
+    uint32_t getNameId(uint32_t node) const { return static_cast<uint32_t>(nameIds.get(node)); }
+
+    // NONE for the root
+    uint32_t parent(uint32_t node) const {
+        return static_cast<uint32_t>(shape.rank0(shape.select1(node)) - 1);
+    }
+
+    // Number of the first child and how many children there are
+    std::pair<uint32_t, uint32_t> children(uint32_t node) const {
+        size_t start = shape.select0(node);
+        size_t end = shape.nextZero(start + 1);
+        return {static_cast<uint32_t>(start - node), static_cast<uint32_t>(end - start - 1)};
+    }
+
+    // The child of 'directory' with name id 'name', or NONE
+    uint32_t child(uint32_t directory, uint32_t name) const {
+        auto [low, count] = children(directory);
+        uint32_t high = low + count;
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            uint32_t id = getNameId(middle);
+            if (id == name) {
+                return middle;
+            }
+            if (id < name) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return NONE;
+    }
+
+    // The directory a path leads to from 'start', resolving '.' and '..';
+    // NONE if there is no such directory. 'where', if given, holds the path
+    // of 'start' and is turned into the path of the result on the way,
+    // which is cheaper than getPath.
+    uint32_t navigate(std::string_view path, uint32_t start, std::string* where = nullptr) const {
+        uint32_t directory = start;
+        PathTokenizer tokenizer(path);
+        std::string_view part;
+        while (tokenizer.next(part)) {
+            if (part == "..") {
+                if (directory != ROOT) {
+                    directory = parent(directory);
+                    if (where != nullptr) {
+                        where->resize(std::max<size_t>(where->rfind('/'), 1));
+                    }
+                }
+            } else if (part != ".") {
+                uint32_t id;
+                uint32_t next = names.lookup(part, id) ? child(directory, id) : NONE;
+                if (next == NONE || !isDirectory(next)) {
+                    return NONE;
+                }
+                directory = next;
+                if (where != nullptr) {
+                    if (where->size() > 1) {
+                        *where += '/';
+                    }
+                    *where += part;
+                }
+            }
+        }
+        return directory;
+    }
+
+    std::string getPath(uint32_t node) const {
+        if (node == ROOT) {
+            return "/";
+        }
+        std::vector<uint32_t> ids;
+        for (uint32_t n = node; n != ROOT; n = parent(n)) {
+            ids.push_back(getNameId(n));
+        }
+        std::string path;
+        std::string name;
+        for (auto id = ids.rbegin(); id != ids.rend(); ++id) {
+            names.get(*id, name);
+            path += '/';
+            path += name;
+        }
+        return path;
+    }
+
+    // Nodes whose names 'matcher' accepts. There is no name index: each
+    // distinct name is tested once, then the packed name ids are scanned.
+    std::vector<uint32_t> find(const NameMatcher& matcher) const {
+        std::vector<uint32_t> matches;
+        if (matcher.getKind() == NameMatcher::Kind::LITERAL) {
+            uint32_t id;
+            if (names.lookup(matcher.getLiteral(), id)) {
+                for (uint32_t node = 0; node < size(); ++node) {
+                    if (getNameId(node) == id) {
+                        matches.push_back(node);
+                    }
+                }
+            }
+            return matches;
+        }
+        std::vector<bool> accepted(names.size());
+        bool any = false;
+        names.forEach([&](uint32_t id, std::string_view name) {
+            if (matcher.matches(name)) {
+                accepted[id] = true;
+                any = true;
+            }
+        });
+        for (uint32_t node = 0; any && node < size(); ++node) {
+            if (accepted[getNameId(node)]) {
+                matches.push_back(node);
+            }
+        }
+        return matches;
+    }
+
+    size_t getShapeBytes() const { return shape.getMemoryUsage() + directoryBits.size() * sizeof(uint64_t); }
+    size_t getNameIdBytes() const { return nameIds.getMemoryUsage(); }
+    unsigned getNameIdBits() const { return nameIds.getWidth(); }
+    size_t getMemoryUsage() const { return getShapeBytes() + getNameIdBytes() + names.getMemoryUsage(); }
+};
+
+// One client of a FileSystem. Each session has its own working directory,
+// so several clients can navigate the same tree at once, and its own output
+// stream. A session must only be used by one thread at a time.
+class Session {
+private:
+    friend class FileSystem;
+    NodeId currentDirectory = NO_NODE;
+    std::string currentPath = "/";
+    uint64_t treeGeneration = 0; // Tree that currentDirectory belongs to
+    uint64_t removalCount = 0;   // Removals seen when it was last checked
+    std::ostream* output;
+
+public:
+    explicit Session(std::ostream& output) : output(&output) {}
+
+    // A session in the same place as 'other' that writes to its own stream
+    Session(const Session& other, std::ostream& output)
+        : currentDirectory(other.currentDirectory), currentPath(other.currentPath),
+          treeGeneration(other.treeGeneration), removalCount(other.removalCount), output(&output) {}
+
+    std::ostream& out() { return *output; }
+};
+
+// The main class that manages the file system operations.
+//
+// Any number of sessions may run commands on different threads at once.
+// Lookups (cd, pwd, ls, find and path resolution in every command) take no
+// locks: they run inside a ReadSection, and directory entries, name chains
+// and names can all be read while they change (see DirectoryEntries and
+// NameTable). Nodes and entry blocks that rm or growth unlinks are handed to
+// the Reclaimer and only freed once every section that could have seen them
+// has ended. The only wait on the read side is while load swaps the tree.
+//
+// Writers serialize per directory: each directory is guarded by one of
+// LOCK_STRIPES reader/writer locks picked by its node id. Creations and
+// removals hold the parent's stripe exclusively, and whole-tree readers
+// (save, export, stats, journal compaction) hold every stripe shared.
+// Nobody takes a second stripe while holding one, except whole-tree readers
+// which take all of them in order, so the stripes cannot deadlock. Every
+// command that writes or needs a stable tree also holds 'treeLock' shared;
+// load takes it exclusively. The node table and name index are guarded by
+// indexLock and the arena locks itself.
+class FileSystem {
+private:
+    static constexpr size_t LOCK_STRIPE_BITS = 8;
+    static constexpr size_t LOCK_STRIPES = size_t(1) << LOCK_STRIPE_BITS;
+
+    mutable ReadWriteLock treeLock;
+    mutable std::array<ReadWriteLock, LOCK_STRIPES> directoryLocks;
+    mutable ReadWriteLock indexLock;
+    // Bumped whenever the tree is replaced, so that sessions still pointing
+    // into the old one move back to the root
+    std::atomic<uint64_t> treeGeneration{1};
+    // Bumped by every rm, so that sessions check their directory still exists
+    std::atomic<uint64_t> removalCount{0};
+    // Set while load swaps in a new tree; new ReadSections wait for it
+    std::atomic<bool> replacing{false};
+
+    // Declared before the nodes that use them so they outlive the nodes.
+    // Held by pointer so that a loaded tree can be swapped in wholesale.
+    std::unique_ptr<Arena> arena = std::make_unique<Arena>();
+    std::unique_ptr<NodeTable> nodes = std::make_unique<NodeTable>();
+    // Declared after the storage it frees into, so it is emptied first
+    Reclaimer reclaimer;
+    NameTable names;
+    NodeId root;
+    // Inverted name index: head of the chain of nodes carrying each name id.
+    // Entries below nameIndexSize are valid.
+    PublishedArray<std::atomic<NodeId>> nodesByName;
+    std::atomic<size_t> nameIndexSize{0};
+    std::atomic<size_t> directoryCount{0};
+    std::atomic<size_t> fileCount{0};
+    // Set once by freeze; from then on lookups go to the frozen copy and
+    // the tree no longer changes
+    std::unique_ptr<FrozenTree> frozenTree;
+    std::atomic<const FrozenTree*> frozen{nullptr};
+    // Persistence (see openJournal); no journal means nothing is persisted.
+    // journalMutex guards the journal and is only ever taken last.
+    std::unique_ptr<Journal> journal;
+    std::mutex journalMutex;
+    std::string dataDirectory;
+    size_t snapshotNodeCount = 0;     // Nodes in the last snapshot written
+
+    // The journal is folded into a fresh snapshot once it holds more
+    // records than this or than the last snapshot had nodes, whichever is
+    // larger, so the cost of rewriting the snapshot is spread over at least
+    // as many mutations
+    static constexpr size_t MIN_COMPACTION_RECORDS = 100000;
+
+    NodeId createNode(NameId name, NodeType type, NodeId parent) {
+        if (type == NodeType::DIRECTORY) {
+            ++directoryCount;
+        } else {
+            ++fileCount;
+        }
+        std::lock_guard<ReadWriteLock> lock(indexLock);
+        NodeId node = nodes->create(name, type, parent, reclaimer);
+        size_t indexed = nameIndexSize.load(std::memory_order_relaxed);
+        if (name >= indexed) {
+            nodesByName.reserve(name + 1, indexed, reclaimer);
+            nameIndexSize.store(name + 1, std::memory_order_release);
+        }
+        std::atomic<NodeId>& head = nodesByName.writable()[name];
+        nodes->nextWithSameName(node).store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        head.store(node, std::memory_order_release);
+        return node;
+    }
+
+    // First node in the chain of nodes named 'name'; needs no lock
+    NodeId firstNamed(NameId name) const {
+        if (name >= nameIndexSize.load(std::memory_order_acquire)) {
+            return NO_NODE;
+        }
+        return nodesByName.data()[name].load(std::memory_order_acquire);
+    }
+
+    // Unlinks removed nodes from their name chains. A reader may be standing
+    // on a removed node; its own link is left alone so that it can carry on.
+    // Callers hold indexLock.
+    void unlinkFromNameIndex(const std::vector<NodeId>& removed) {
+        std::vector<NameId> ids;
+        ids.reserve(removed.size());
+        for (NodeId node : removed) {
+            ids.push_back(nodes->name(node));
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        for (NameId id : ids) {
+            std::atomic<NodeId>* link = &nodesByName.writable()[id];
+            for (NodeId node = link->load(std::memory_order_relaxed); node != NO_NODE;
+                 node = link->load(std::memory_order_relaxed)) {
+                if (nodes->removed(node).load(std::memory_order_relaxed)) {
+                    link->store(nodes->nextWithSameName(node).load(std::memory_order_relaxed),
+                                std::memory_order_release);
+                } else {
+                    link = &nodes->nextWithSameName(node);
+                }
+            }
+        }
+    }
+
+    // Stripe guarding 'directory': a Fibonacci hash of its node id, so
+    // consecutive ids spread over all the stripes
+    ReadWriteLock& lockFor(NodeId directory) const {
+        uint64_t hash = static_cast<uint64_t>(directory) * 0x9E3779B97F4A7C15ull;
+        return directoryLocks[hash >> (64 - LOCK_STRIPE_BITS)];
+    }
+
+    // Holds every directory stripe shared, so the shape of the tree cannot
+    // change while it is alive
+    class WholeTreeReadLock {
+    private:
+        const FileSystem& fileSystem;
+
+    public:
+        explicit WholeTreeReadLock(const FileSystem& fileSystem) : fileSystem(fileSystem) {
+            for (auto& stripe : fileSystem.directoryLocks) {
+                stripe.lock_shared();
+            }
+        }
+
+        ~WholeTreeReadLock() {
+            for (auto& stripe : fileSystem.directoryLocks) {
+                stripe.unlock_shared();
+            }
+        }
+
+        WholeTreeReadLock(const WholeTreeReadLock&) = delete;
+        WholeTreeReadLock& operator=(const WholeTreeReadLock&) = delete;
+    };
+
+    // Every command runs inside one. Lookups in it need no locks, because
+    // nothing they can reach is freed before it ends (see Epochs). New
+    // sections only wait while load swaps in a new tree; a thread already
+    // inside one is let through, since load is waiting for it to finish.
+    class ReadSection {
+    private:
+        std::optional<Epochs::ReadGuard> guard;
+
+    public:
+        explicit ReadSection(const FileSystem& fileSystem) {
+            bool nested = Epochs::isReading();
+            while (true) {
+                guard.emplace();
+                if (nested || !fileSystem.replacing.load(std::memory_order_seq_cst)) {
+                    return;
+                }
+                guard.reset();
+                while (fileSystem.replacing.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    };
+
+    size_t getNodeCount() const {
+        return directoryCount.load() + fileCount.load();
+    }
+
+    // The session's working directory. A session whose tree has been
+    // replaced moves back to the root; one that may have lost its directory
+    // to rm since its last command finds it again by path, falling back to
+    // the nearest ancestor that still exists. Callers are in a ReadSection.
+    NodeId workingDirectory(Session& session) {
+        uint64_t generation = treeGeneration.load(std::memory_order_acquire);
+        uint64_t removals = removalCount.load(std::memory_order_acquire);
+        if (session.treeGeneration != generation) {
+            session.currentDirectory = root;
+            session.currentPath = "/";
+        } else if (session.removalCount != removals) {
+            NodeId directory;
+            while ((directory = navigateToPath(session.currentPath, root)) == NO_NODE) {
+                session.currentPath.resize(std::max<size_t>(session.currentPath.rfind('/'), 1));
+            }
+            session.currentDirectory = directory;
+        }
+        session.treeGeneration = generation;
+        session.removalCount = removals;
+        return session.currentDirectory;
+    }
+
+    // The session's working directory once the tree is frozen: a session
+    // that was in the tree when it was frozen stays in its directory (or the
+    // nearest ancestor, if that was removed meanwhile); sessions from older
+    // trees move to the root. Callers are in a ReadSection.
+    uint32_t frozenWorkingDirectory(Session& session, const FrozenTree& tree) {
+        uint64_t generation = treeGeneration.load(std::memory_order_acquire);
+        if (session.treeGeneration != generation) {
+            if (session.treeGeneration + 1 != generation) {
+                session.currentPath = "/";
+            }
+            uint32_t directory;
+            while ((directory = tree.navigate(session.currentPath, FrozenTree::ROOT)) == FrozenTree::NONE) {
+                session.currentPath.resize(std::max<size_t>(session.currentPath.rfind('/'), 1));
+            }
+            session.currentDirectory = directory;
+            session.treeGeneration = generation;
+        }
+        return session.currentDirectory;
+    }
+
+    // Helper for commands that change the tree or need the mutable one:
+    // reports and returns true once the tree is frozen. Callers hold
+    // treeLock, so it cannot be frozen while they run.
+    bool refuseIfFrozen(Session& session) {
+        if (frozen.load(std::memory_order_acquire) == nullptr) {
+            return false;
+        }
+        session.out() << "Error: The tree is frozen (read-only)." << '\n';
+        return true;
+    }
+
+    // Snapshot layout: header, name table, then one record per node in
+    // breadth-first order so that every directory's children form a
+    // contiguous range of records
+    static constexpr char SNAPSHOT_MAGIC[8] = {'F', 'S', 'N', 'A', 'V', 'S', 'N', 'P'};
+    static constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t nodeCount;
+    };
+
+    struct SnapshotNode {
+        NameId name;
+        uint32_t type;
+        uint32_t firstChild;
+        uint32_t childCount;
+    };
+
+    // Creates the nodes described by snapshot records below the (empty)
+    // root. Returns false if the records do not describe a tree.
+    bool buildFromSnapshot(const char* data, uint32_t nodeCount) {
+        std::vector<NodeId> created(nodeCount, NO_NODE);
+        created[0] = root;
+        uint32_t nextChild = 1;
+        for (uint32_t i = 0; i < nodeCount; ++i) {
+            SnapshotNode record;
+            std::memcpy(&record, data + uint64_t(i) * sizeof(SnapshotNode), sizeof(record));
+            NodeId node = created[i];
+            // Children must follow their parent, in order, and be in range
+            if (node == NO_NODE || record.name != nodes->name(node) || record.firstChild != nextChild ||
+                record.childCount > nodeCount - nextChild ||
+                (record.childCount > 0 && !NodeTable::isDirectory(node))) {
+                return false;
+            }
+            if (record.childCount == 0) {
+                continue;
+            }
+            DirectoryEntries& children = nodes->children(node);
+            children.reserve(record.childCount, *arena, reclaimer);
+            for (uint32_t c = record.firstChild; c < record.firstChild + record.childCount; ++c) {
+                SnapshotNode child;
+                std::memcpy(&child, data + uint64_t(c) * sizeof(SnapshotNode), sizeof(child));
+                if (child.name >= names.size() || child.type > static_cast<uint32_t>(NodeType::DIRECTORY)) {
+                    return false;
+                }
+                auto slot = children.tryEmplace(child.name, *arena, reclaimer);
+                if (!slot.second) {
+                    return false;
+                }
+                created[c] = createNode(child.name, static_cast<NodeType>(child.type), node);
+                slot.first->store(created[c], std::memory_order_release);
+            }
+            nextChild += record.childCount;
+        }
+        return nextChild == nodeCount;
+    }
+
+    // Helper to write the tree to a snapshot file and sync it to disk. The
+    // caller holds a WholeTreeReadLock.
+    bool writeSnapshot(const std::string& fileName, std::string& error) {
+        std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            error = "Cannot open '" + fileName + "' for writing.";
+            return false;
+        }
+
+        // Breadth-first, so each directory's children are consecutive
+        // records starting after everything queued before them
+        std::vector<SnapshotNode> records;
+        records.reserve(getNodeCount());
+        uint32_t queued = 1;
+        TreeWalker::breadthFirst(*nodes, root, [&](const TreeWalker::Entry& entry, size_t) {
+            uint32_t childCount = static_cast<uint32_t>(nodes->getChildCount(entry.node));
+            records.push_back({entry.name, static_cast<uint32_t>(NodeTable::type(entry.node)), queued, childCount});
+            queued += childCount;
+            return true;
+        });
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.nodeCount = static_cast<uint32_t>(records.size());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        names.save(out);
+        out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SnapshotNode));
+        out.close();
+        FILE* written = out ? std::fopen(fileName.c_str(), "ab") : nullptr;
+        bool synced = written != nullptr && syncFile(written);
+        if (written != nullptr) {
+            std::fclose(written);
+        }
+        if (!synced) {
+            error = "Failed writing '" + fileName + "'.";
+            return false;
+        }
+        return true;
+    }
+
+    // Helper to replace the tree with one read from a snapshot file. The
+    // file is mapped and the name table is copied in bulk; nodes are rebuilt
+    // straight from the fixed-size records without any parsing. The caller
+    // holds treeLock exclusively (or is the only thread).
+    bool readSnapshot(const std::string& fileName, std::string& error) {
+        MappedFile file(fileName);
+        if (!file.isOpen()) {
+            error = "Cannot open '" + fileName + "'.";
+            return false;
+        }
+        const char* data = file.getData();
+        size_t remaining = file.size();
+
+        SnapshotHeader header;
+        error = "'" + fileName + "' is not a valid snapshot.";
+        if (remaining < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        data += sizeof(header);
+        remaining -= sizeof(header);
+
+        FileSystem loaded;
+        size_t nameBytes = 0;
+        bool valid = std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+                     header.version == SNAPSHOT_VERSION && header.nodeCount > 0 &&
+                     (nameBytes = loaded.names.load(data, remaining)) != 0 &&
+                     remaining - nameBytes == uint64_t(header.nodeCount) * sizeof(SnapshotNode);
+        if (valid) {
+            data += nameBytes;
+            valid = loaded.buildFromSnapshot(data, header.nodeCount);
+        }
+        if (!valid) {
+            return false;
+        }
+        error.clear();
+        swapTree(loaded);
+        return true;
+    }
+
+    // Helper to re-apply one journal record. Records hold absolute paths;
+    // nodes that already exist are skipped and removals of missing nodes
+    // ignored, so that replaying records already covered by the snapshot is
+    // harmless.
+    void replayMutation(Journal::Operation operation, std::string_view nodePath) {
+        size_t slash = nodePath.rfind('/');
+        if (slash == std::string_view::npos || slash + 1 == nodePath.size()) {
+            return;
+        }
+        NodeId directory = slash == 0 ? root : navigateToPath(nodePath.substr(0, slash), root);
+        if (directory == NO_NODE) {
+            return;
+        }
+        std::string_view name = nodePath.substr(slash + 1);
+        NameId id;
+        if (operation == Journal::Operation::REMOVE) {
+            if (names.lookup(name, id)) {
+                removeChild(directory, id, true);
+            }
+            return;
+        }
+        createChild(directory, name, operation == Journal::Operation::MKDIR ? NodeType::DIRECTORY : NodeType::FILE);
+    }
+
+    // Moves another file system's tree into this one (used by load). Waits
+    // for every lookup in the old tree to finish, holding new ones back, and
+    // sends every session back to the root of the new tree. The caller holds
+    // treeLock exclusively and must not be in a ReadSection.
+    void swapTree(FileSystem& other) {
+        replacing.store(true, std::memory_order_seq_cst);
+        Epochs::synchronize();
+        // Nobody can reach the old tree now, so whatever it retired can go
+        reclaimer.releaseAll();
+        std::swap(arena, other.arena);
+        std::swap(nodes, other.nodes);
+        reclaimer.swap(other.reclaimer);
+        names.swap(other.names);
+        std::swap(root, other.root);
+        nodesByName.swap(other.nodesByName);
+        nameIndexSize = other.nameIndexSize.exchange(nameIndexSize);
+        directoryCount = other.directoryCount.exchange(directoryCount);
+        fileCount = other.fileCount.exchange(fileCount);
+        ++treeGeneration;
+        replacing.store(false, std::memory_order_release);
+    }
+
+    // Moves a rebuilt copy of this tree's nodes into place (used by
+    // compact). Like swapTree it waits for every lookup in the old nodes to
+    // finish, but the names stay and sessions find their directories again
+    // by path. The caller holds treeLock exclusively and must not be in a
+    // ReadSection.
+    void swapNodes(std::unique_ptr<NodeTable>& table, std::unique_ptr<Arena>& storage,
+                   PublishedArray<std::atomic<NodeId>>& index, NodeId newRoot) {
+        replacing.store(true, std::memory_order_seq_cst);
+        Epochs::synchronize();
+        reclaimer.releaseAll();
+        std::swap(arena, storage);
+        std::swap(nodes, table);
+        root = newRoot;
+        nodesByName.swap(index);
+        ++removalCount;
+        replacing.store(false, std::memory_order_release);
+    }
+
+    // Helper to add a child to a directory; returns NO_NODE if the name is
+    // taken or the directory has been removed. The journal record is written
+    // while the parent is still locked, so a record never precedes the
+    // record of the directory it lives in.
+    NodeId createChild(NodeId directory, std::string_view name, NodeType type) {
+        std::lock_guard<ReadWriteLock> lock(lockFor(directory));
+        if (nodes->removed(directory).load(std::memory_order_acquire)) {
+            return NO_NODE;
+        }
+        NameId id = names.intern(name, reclaimer);
+        auto slot = nodes->children(directory).tryEmplace(id, *arena, reclaimer);
+        if (!slot.second) {
+            return NO_NODE;
+        }
+        NodeId node = createNode(id, type, directory);
+        slot.first->store(node, std::memory_order_release);
+        if (journal != nullptr) {
+            std::lock_guard<std::mutex> journalLock(journalMutex);
+            journal->append(type == NodeType::DIRECTORY ? Journal::Operation::MKDIR : Journal::Operation::TOUCH,
+                            getPath(node));
+        }
+        return node;
+    }
+
+    enum class RemoveResult {
+        REMOVED,
+        MISSING,
+        NOT_EMPTY
+    };
+
+    // Helper to remove a directory's child and, with 'recursive', everything
+    // below it. The child is unlinked first, so no new lookup can reach the
+    // subtree. Each directory in it is then marked removed under its own
+    // lock, which stops further creations there, and its entries collected.
+    // The nodes are freed once no lookup that started earlier can still be
+    // using them.
+    RemoveResult removeChild(NodeId directory, NameId id, bool recursive) {
+        std::vector<NodeId> removed;
+        {
+            std::lock_guard<ReadWriteLock> lock(lockFor(directory));
+            NodeId target = nodes->removed(directory).load(std::memory_order_acquire)
+                                ? NO_NODE
+                                : nodes->children(directory).find(id);
+            if (target == NO_NODE) {
+                return RemoveResult::MISSING;
+            }
+            if (!recursive && nodes->getChildCount(target) != 0) {
+                return RemoveResult::NOT_EMPTY;
+            }
+            if (journal != nullptr) {
+                std::lock_guard<std::mutex> journalLock(journalMutex);
+                journal->append(Journal::Operation::REMOVE, getPath(target));
+            }
+            nodes->children(directory).remove(id);
+            nodes->removed(target).store(true, std::memory_order_release);
+            ++removalCount;
+            removed.push_back(target);
+        }
+        // Marking a directory under its lock means any creation in it
+        // either finished before (and is seen by the walk) or fails
+        size_t directories = 0;
+        TreeWalker::breadthFirst(*nodes, removed.front(), [&](const TreeWalker::Entry& entry, size_t depth) {
+            NodeId node = entry.node;
+            if (NodeTable::isDirectory(node)) {
+                ++directories;
+                std::lock_guard<ReadWriteLock> lock(lockFor(node));
+                nodes->removed(node).store(true, std::memory_order_release);
+            } else {
+                nodes->removed(node).store(true, std::memory_order_release);
+            }
+            if (depth != 0) {
+                removed.push_back(node);
+            }
+            return true;
+        });
+        directoryCount -= directories;
+        fileCount -= removed.size() - directories;
+        {
+            std::lock_guard<ReadWriteLock> index(indexLock);
+            unlinkFromNameIndex(removed);
+        }
+        Arena* storage = arena.get();
+        NodeTable* table = nodes.get();
+        reclaimer.retire([this, storage, table, removed = std::move(removed)] {
+            std::lock_guard<ReadWriteLock> index(indexLock);
+            for (NodeId node : removed) {
+                if (NodeTable::isDirectory(node)) {
+                    table->children(node).release(*storage);
+                }
+                table->destroy(node);
+            }
+        });
+        return RemoveResult::REMOVED;
+    }
+
+    // Helper to create a file or directory in the session's directory,
+    // reporting why it could not be
+    bool createInWorkingDirectory(Session& session, std::string_view name, NodeType type) {
+        std::shared_lock<ReadWriteLock> tree(treeLock);
+        if (refuseIfFrozen(session)) {
+            return false;
+        }
+        ReadSection section(*this);
+        NodeId directory = workingDirectory(session);
+        if (createChild(directory, name, type) != NO_NODE) {
+            return true;
+        }
+        if (nodes->removed(directory).load(std::memory_order_acquire)) {
+            session.out() << "Error: The current directory has been removed." << '\n';
+        } else {
+            session.out() << "Error: '" << name << "' already exists." << '\n';
+        }
+        return false;
+    }
+
+    // Helper to fold the journal into a snapshot once it has grown enough.
+    // Called with no lock held; treeLock is taken like any other writer
+    // takes it, so a load or freeze cannot replace the tree mid-snapshot.
+    void compactJournalIfNeeded(Session& session) {
+        if (journal == nullptr) {
+            return;
+        }
+        std::shared_lock<ReadWriteLock> tree(treeLock);
+        {
+            std::lock_guard<std::mutex> journalLock(journalMutex);
+            if (journal->getRecordCount() < std::max(MIN_COMPACTION_RECORDS, snapshotNodeCount)) {
+                return;
+            }
+        }
+        compactJournal(session.out());
+    }
+
+    // Helper for commands that change the tree: tells the session while the
+    // journal cannot be written, since its change is then not yet durable.
+    // The records stay in memory and are written again at the next commit.
+    void reportJournalFailure(Session& session) {
+        if (journal == nullptr) {
+            return;
+        }
+        std::lock_guard<std::mutex> journalLock(journalMutex);
+        if (!journal->getError().empty()) {
+            session.out() << "Error: Cannot write the journal: " << journal->getError()
+                          << " (changes are kept and written again later)." << '\n';
+        }
+    }
+
+    std::string snapshotPath() const {
+        return (std::filesystem::path(dataDirectory) / "snapshot.bin").string();
+    }
+
+    std::string journalPath() const {
+        return (std::filesystem::path(dataDirectory) / "journal.log").string();
+    }
+
+    // Folds the journal into a new snapshot: the snapshot is written to a
+    // temporary file, synced and renamed over the old one, and the rename is
+    // synced, before the journal is emptied. A crash in between only means
+    // some records are replayed again, which is harmless because replay
+    // skips nodes that exist. Errors go to 'out'. The caller holds
+    // treeLock, shared or exclusively.
+    void compactJournal(std::ostream& out) {
+        // A frozen tree has let go of its nodes; the files on disk still
+        // describe it
+        if (frozen.load(std::memory_order_acquire) != nullptr) {
+            return;
+        }
+        WholeTreeReadLock treeShape(*this);
+        std::lock_guard<std::mutex> journalLock(journalMutex);
+        // Committed first so the journal still holds everything if the
+        // snapshot cannot be written; if this fails the snapshot covers it
+        journal->commit();
+        std::string temporary = snapshotPath() + ".tmp";
+        std::string error;
+        if (!writeSnapshot(temporary, error)) {
+            out << "Error: Journal compaction failed: " << error << '\n';
+            return;
+        }
+        std::error_code renameError;
+        std::filesystem::rename(temporary, snapshotPath(), renameError);
+        if (renameError) {
+            out << "Error: Journal compaction failed: " << renameError.message() << '\n';
+            return;
+        }
+        if (!syncDirectory(dataDirectory)) {
+            out << "Error: Journal compaction failed: Cannot sync '" << dataDirectory << "'." << '\n';
+            return;
+        }
+        if (!journal->reset(error)) {
+            out << "Warning: Cannot empty journal '" << journalPath() << "': " << error << '\n';
+        }
+        snapshotNodeCount = getNodeCount();
+    }
+
+    // Helper for scan-mode 'find': visits every node below startNode on
+    // 'threadCount' threads, one task per directory, and returns the nodes
+    // whose names are accepted by 'matches'. A single thread walks the tree
+    // in place.
+    template <typename Predicate>
+    std::vector<NodeId> parallelScan(NodeId startNode, size_t threadCount, Predicate matches) {
+        if (threadCount == 1) {
+            std::vector<NodeId> results;
+            TreeWalker::breadthFirst(*nodes, startNode, [&](const TreeWalker::Entry& entry, size_t) {
+                if (matches(entry.name)) {
+                    results.push_back(entry.node);
+                }
+                return true;
+            });
+            return results;
+        }
+        WorkStealingScheduler<NodeId> scheduler(threadCount);
+        std::vector<std::vector<NodeId>> workerResults(scheduler.getThreadCount());
+
+        if (matches(nodes->name(startNode))) {
+            workerResults[0].push_back(startNode);
+        }
+        if (NodeTable::isDirectory(startNode)) {
+            scheduler.push(0, startNode);
+        }
+        // The workers read without locks under the caller's ReadSection,
+        // which outlasts them
+        scheduler.run([&](NodeId directory, size_t worker) {
+            for (const auto& entry : nodes->children(directory).view()) {
+                if (matches(entry.name)) {
+                    workerResults[worker].push_back(entry.node);
+                }
+                if (nodes->getChildCount(entry.node) != 0) {
+                    scheduler.push(worker, entry.node);
+                }
+            }
+        });
+
+        std::vector<NodeId> results;
+        for (const auto& buffer : workerResults) {
+            results.insert(results.end(), buffer.begin(), buffer.end());
+        }
+        return results;
+    }
+
+    // Helper function to change directory and refresh the cached path. A
+    // step to a child or to the parent edits the path in place, so cd in a
+    // deep chain does not cost a walk to the root; other moves rebuild it.
+    void setCurrentDirectory(Session& session, NodeId directory) {
+        NodeId previous = session.currentDirectory;
+        if (directory == previous) {
+            return;
+        }
+        session.currentDirectory = directory;
+        if (nodes->parent(directory) == previous) {
+            if (previous != root) {
+                session.currentPath += '/';
+            }
+            session.currentPath += names.get(nodes->name(directory));
+        } else if (directory == nodes->parent(previous)) {
+            session.currentPath.resize(std::max<size_t>(session.currentPath.rfind('/'), 1));
+        } else {
+            session.currentPath = getPath(directory);
+        }
+    }
+
+    // Helper function to check if a name is valid (no '/' characters)
+    bool isValidName(std::string_view name) {
+        return name.find('/') == std::string_view::npos;
+    }
+
+    // Helper function to navigate to a directory by path, resolving '.' and
+    // '..' as the components are read
+    NodeId navigateToPath(std::string_view path, NodeId startNode) {
+        NodeId targetNode = startNode;
+        PathTokenizer tokenizer(path);
+        std::string_view part;
+
+        while (tokenizer.next(part)) {
+            if (part == "..") {
+                if (nodes->parent(targetNode) != NO_NODE) {
+                    targetNode = nodes->parent(targetNode);
+                }
+            } else if (part != ".") {
+                NameId id;
+                NodeId child = names.lookup(part, id) ? nodes->children(targetNode).find(id) : NO_NODE;
+                if (child == NO_NODE) {
+                    return NO_NODE; // Path not found
+                }
+                if (!NodeTable::isDirectory(child)) {
+                    return NO_NODE; // Not a directory
+                }
+                targetNode = child;
+            }
+        }
+        return targetNode;
+    }
+
+
 public:
-    std::string name;
-    NodeType type;
-    Node* parent;
-    std::map<std::string, std::unique_ptr<Node>> children; // Only used by directories
+    FileSystem() {
+        // The root directory has no parent
+        root = createNode(names.intern("/", reclaimer), NodeType::DIRECTORY, NO_NODE);
+    }
+
+    FileSystem(const FileSystem&) = delete;
+    FileSystem& operator=(const FileSystem&) = delete;
+
+    ~FileSystem() {
+        // The node table frees its columns chunk by chunk and the arena then
+        // releases all child-map storage in a handful of chunk frees
+    }
+      // Get the full path of a given node
+    std::string getPath(NodeId node) const {
+        if (node == root) {
+            return "/";
+        }
+        // Walk up once to size the result, then fill it in from the back
+        size_t length = 0;
+        for (NodeId n = node; n != root; n = nodes->parent(n)) {
+            length += 1 + names.get(nodes->name(n)).size();
+        }
+        std::string path(length, '/');
+        for (NodeId n = node; n != root; n = nodes->parent(n)) {
+            std::string_view name = names.get(nodes->name(n));
+            length -= name.size();
+            path.replace(length, name.size(), name);
+            --length;
+        }
+        return path;
+    }
+
+    // Path of the session's current directory, kept up to date by cd (for
+    // the prompt)
+    const std::string& getCurrentPath(Session& session) {
+        ReadSection section(*this);
+        if (const FrozenTree* tree = frozen.load(std::memory_order_acquire)) {
+            frozenWorkingDirectory(session, *tree);
+        } else {
+            workingDirectory(session);
+        }
+        return session.currentPath;
+    }
+
+    // Print Working Directory (pwd)
+    void pwd(Session& session) {
+        session.out() << getCurrentPath(session) << '\n';
+    }
+
+    // List contents (ls)
+    void ls(Session& session) {
+        ReadSection section(*this);
+        if (const FrozenTree* tree = frozen.load(std::memory_order_acquire)) {
+            // Frozen children are numbered in name order already
+            auto [first, count] = tree->children(frozenWorkingDirectory(session, *tree));
+            std::string name;
+            for (uint32_t child = first; child < first + count; ++child) {
+                tree->getNames().get(tree->getNameId(child), name);
+                session.out() << name;
+                if (tree->isDirectory(child)) {
+                    session.out() << "/";
+                }
+                session.out() << '\n';
+            }
+            return;
+        }
+        const DirectoryEntries& children = nodes->children(workingDirectory(session));
+        // Children are keyed by name id, so sort by the actual names for display
+        std::vector<DirectoryEntries::Entry> entries;
+        entries.reserve(children.size());
+        for (const auto& entry : children.view()) {
+            entries.push_back(entry);
+        }
+        std::sort(entries.begin(), entries.end(), [this](const auto& a, const auto& b) {
+            return names.get(a.name) < names.get(b.name);
+        });
+        for (const auto& entry : entries) {
+            session.out() << names.get(entry.name);
+            if (NodeTable::isDirectory(entry.node)) {
+                session.out() << "/";
+            }
+            session.out() << '\n';
+        }
+    }
+
+    // Make Directory (mkdir)
+    void mkdir(Session& session, std::string_view dirName) {
+        if (!isValidName(dirName)) {
+            session.out() << "Error: Directory name cannot contain '/'." << '\n';
+            return;
+        }
+        if (!createInWorkingDirectory(session, dirName, NodeType::DIRECTORY)) {
+            return;
+        }
+        reportJournalFailure(session);
+        compactJournalIfNeeded(session);
+    }
+
+    // Create a file (touch)
+    void touch(Session& session, std::string_view fileName) {
+        if (!isValidName(fileName)) {
+            session.out() << "Error: File name cannot contain '/'." << '\n';
+            return;
+        }
+        if (!createInWorkingDirectory(session, fileName, NodeType::FILE)) {
+            return;
+        }
+        reportJournalFailure(session);
+        compactJournalIfNeeded(session);
+    }
+
+    // Remove a file or directory (rm). Directories must be empty unless
+    // 'recursive' is set. Sessions inside a removed directory move up to the
+    // nearest ancestor that is left.
+    void rm(Session& session, std::string_view path, bool recursive) {
+        while (path.size() > 1 && path.back() == '/') {
+            path.remove_suffix(1);
+        }
+        size_t slash = path.rfind('/');
+        std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+        if (path == "/") {
+            session.out() << "Error: Cannot remove the root directory." << '\n';
+            return;
+        }
+        if (name == "." || name == "..") {
+            session.out() << "Error: Cannot remove '.' or '..'." << '\n';
+            return;
+        }
+        {
+            std::shared_lock<ReadWriteLock> tree(treeLock);
+            if (refuseIfFrozen(session)) {
+                return;
+            }
+            ReadSection section(*this);
+            NodeId directory = workingDirectory(session);
+            if (slash == 0) {
+                directory = root;
+            } else if (slash != std::string_view::npos) {
+                directory = navigateToPath(path.substr(0, slash), path[0] == '/' ? root : directory);
+            }
+            NameId id;
+            RemoveResult result = RemoveResult::MISSING;
+            if (directory != NO_NODE && names.lookup(name, id)) {
+                result = removeChild(directory, id, recursive);
+            }
+            if (result == RemoveResult::MISSING) {
+                session.out() << "Error: Invalid path '" << path << "'." << '\n';
+                return;
+            }
+            if (result == RemoveResult::NOT_EMPTY) {
+                session.out() << "Error: Directory '" << path << "' is not empty (use 'rm -r')." << '\n';
+                return;
+            }
+        }
+        // Outside the section, so that this session does not hold back its
+        // own removal
+        reclaimer.collect();
+        reportJournalFailure(session);
+        compactJournalIfNeeded(session);
+    }
+
+    // Change Directory (cd)
+    void cd(Session& session, std::string_view path) {
+        ReadSection section(*this);
+        if (const FrozenTree* tree = frozen.load(std::memory_order_acquire)) {
+            uint32_t current = frozenWorkingDirectory(session, *tree);
+            std::string targetPath = path[0] == '/' ? "/" : session.currentPath;
+            uint32_t target = tree->navigate(path, path[0] == '/' ? FrozenTree::ROOT : current, &targetPath);
+            if (target == FrozenTree::NONE) {
+                session.out() << "Error: Invalid path '" << path << "'." << '\n';
+            } else {
+                session.currentDirectory = target;
+                session.currentPath = std::move(targetPath);
+            }
+            return;
+        }
+        if (path == "/") {
+            workingDirectory(session);
+            setCurrentDirectory(session, root);
+            return;
+        }
+
+        // Brought up to date even for absolute paths, or the next command
+        // would take the session for one from an older tree
+        NodeId current = workingDirectory(session);
+        NodeId targetNode = navigateToPath(path, path[0] == '/' ? root : current);
+        if (targetNode != NO_NODE) {
+            setCurrentDirectory(session, targetNode);
+        } else {
+            session.out() << "Error: Invalid path '" << path << "'." << '\n';
+        }
+    }
+
+    // Helper to gather the live nodes named 'name' from the name index.
+    // Removed nodes are unlinked from their chains only after they are
+    // marked, so a walk may still pass over some; they are skipped here.
+    void collectNamed(NameId name, std::vector<NodeId>& matches) const {
+        for (NodeId node = firstNamed(name); node != NO_NODE;
+             node = nodes->nextWithSameName(node).load(std::memory_order_acquire)) {
+            if (!nodes->removed(node).load(std::memory_order_acquire)) {
+                matches.push_back(node);
+            }
+        }
+    }
+
+    // Find files or directories by name or pattern. By default the pattern
+    // is tested once per distinct name and the name index hands back the
+    // nodes carrying each matching name; with a thread count the whole tree
+    // is scanned in parallel instead. A frozen tree is always scanned once.
+    void find(Session& session, const std::string& pattern, FindMode mode = FindMode::EXACT, size_t threadCount = 0) {
+        std::unique_ptr<NameMatcher> matcher;
+        try {
+            matcher = std::make_unique<NameMatcher>(pattern, mode);
+        } catch (const std::regex_error&) {
+            session.out() << "Error: Invalid regular expression '" << pattern << "'." << '\n';
+            return;
+        }
+
+        ReadSection section(*this);
+        std::vector<std::string> results;
+        if (const FrozenTree* tree = frozen.load(std::memory_order_acquire)) {
+            // No name index and no threads: one pass over the frozen names
+            // and one over the nodes' packed name ids
+            for (uint32_t node : tree->find(*matcher)) {
+                results.push_back(tree->getPath(node));
+            }
+        } else {
+            std::vector<NodeId> matches;
+            if (matcher->getKind() == NameMatcher::Kind::LITERAL) {
+                NameId id;
+                if (!names.lookup(matcher->getLiteral(), id)) {
+                    // Nothing can match a name that was never interned
+                } else if (threadCount == 0) {
+                    collectNamed(id, matches);
+                } else {
+                    matches = parallelScan(root, threadCount, [id](NameId name) { return name == id; });
+                }
+            } else if (threadCount == 0) {
+                std::vector<NameId> ids;
+                switch (matcher->getKind()) {
+                    case NameMatcher::Kind::PREFIX:
+                        names.findWithPrefix(matcher->getLiteral(), ids);
+                        break;
+                    case NameMatcher::Kind::SUFFIX:
+                        names.findWithSuffix(matcher->getLiteral(), ids);
+                        break;
+                    case NameMatcher::Kind::CONTAINS:
+                        names.findContaining(matcher->getLiteral(), ids);
+                        break;
+                    default:
+                        for (NameId id = 0; id < names.size(); ++id) {
+                            if (matcher->matches(names.get(id))) {
+                                ids.push_back(id);
+                            }
+                        }
+                        break;
+                }
+                for (NameId id : ids) {
+                    collectNamed(id, matches);
+                }
+            } else {
+                matches = parallelScan(root, threadCount, [this, &matcher](NameId name) {
+                    return matcher->matches(names.get(name));
+                });
+            }
+            results.reserve(matches.size());
+            for (NodeId node : matches) {
+                results.push_back(getPath(node));
+            }
+        }
+        // Chain order is unspecified, so report matches in depth-first name
+        // order. Ranking '/' below every other character compares the paths
+        // one component at a time, so "/a/x" comes before "/a.b/x".
+        std::sort(results.begin(), results.end(), [](const std::string& a, const std::string& b) {
+            auto rank = [](char c) { return c == '/' ? 0 : static_cast<unsigned char>(c) + 1; };
+            auto [left, right] = std::mismatch(a.begin(), a.end(), b.begin(), b.end());
+            if (right == b.end()) {
+                return false;
+            }
+            return left == a.end() || rank(*left) < rank(*right);
+        });
+
+        if (results.empty()) {
+            session.out() << "No file or directory " << (mode == FindMode::EXACT ? "named" : "matching")
+                          << " '" << pattern << "' found." << '\n';
+        } else {
+            for (const auto& path : results) {
+                session.out() << path << '\n';
+            }
+        }
+    }
+
+    // Write the whole tree to a binary snapshot file (save)
+    void save(Session& session, const std::string& fileName) {
+        std::shared_lock<ReadWriteLock> tree(treeLock);
+        if (refuseIfFrozen(session)) {
+            return;
+        }
+        WholeTreeReadLock treeShape(*this);
+        std::string error;
+        if (!writeSnapshot(fileName, error)) {
+            session.out() << "Error: " << error << '\n';
+            return;
+        }
+        session.out() << "Saved " << getNodeCount() << " nodes to '" << fileName << "'." << '\n';
+    }
+
+    // Replace the tree with one read from a snapshot file (load). Waits for
+    // every other session's command to finish first.
+    void load(Session& session, const std::string& fileName) {
+        std::unique_lock<ReadWriteLock> tree(treeLock);
+        if (refuseIfFrozen(session)) {
+            return;
+        }
+        std::string error;
+        if (!readSnapshot(fileName, error)) {
+            session.out() << "Error: " << error << '\n';
+            return;
+        }
+        session.out() << "Loaded " << getNodeCount() << " nodes from '" << fileName << "'." << '\n';
+        // The journal only describes changes to the previous tree
+        if (journal != nullptr) {
+            compactJournal(session.out());
+        }
+    }
 
-    // Constructor
-    Node(const std::string& name, NodeType type, Node* parent = nullptr)
-        : name(name), type(type), parent(parent) {}
+    // Rebuild the node table and child indexes in depth-first order
+    // (compact). After many creations and removals a directory's entries
+    // and the child indexes a walk reads one after another are spread all
+    // over memory, with the holes of removed nodes in between. Here every
+    // node is renumbered in the order a depth-first walk meets it and every
+    // child index is allocated at its exact size in that same order, so
+    // later walks stream through memory. Waits for every other session's
+    // command to finish first; sessions stay in their directories.
+    void compact(Session& session) {
+        std::unique_lock<ReadWriteLock> tree(treeLock);
+        if (refuseIfFrozen(session)) {
+            return;
+        }
+        reclaimer.collect();
+        auto start = std::chrono::steady_clock::now();
+        size_t bytesBefore = nodes->getBytesReserved() + arena->getBytesReserved();
 
-    // Destructor: Memory management is now handled by unique_ptr automatically
-    ~Node() = default;
-};
+        auto table = std::make_unique<NodeTable>();
+        auto storage = std::make_unique<Arena>();
+        PublishedArray<std::atomic<NodeId>> index;
+        size_t indexed = nameIndexSize.load(std::memory_order_relaxed);
+        index.reserve(indexed, 0, reclaimer);
+        // New ids of the directories open in the walk, by depth
+        std::vector<NodeId> copies;
+        TreeWalker::preOrder(*nodes, root, [&](const TreeWalker::Entry& entry, size_t depth) {
+            NodeType type = NodeTable::type(entry.node);
+            NodeId copy = table->create(entry.name, type, depth == 0 ? NO_NODE : copies[depth - 1], reclaimer);
+            std::atomic<NodeId>& head = index.writable()[entry.name];
+            table->nextWithSameName(copy).store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            head.store(copy, std::memory_order_relaxed);
+            if (depth != 0) {
+                auto slot = table->children(copies[depth - 1]).tryEmplace(entry.name, *storage, reclaimer);
+                slot.first->store(copy, std::memory_order_relaxed);
+            }
+            if (type == NodeType::DIRECTORY) {
+                table->children(copy).reserve(nodes->getChildCount(entry.node), *storage, reclaimer);
+                copies.resize(depth);
+                copies.push_back(copy);
+            }
+            return true;
+        });
+        NodeId newRoot = copies.front();
+        swapNodes(table, storage, index, newRoot);
 
-// The main class that manages the file system operations
-class FileSystem {
-private:
-    std::unique_ptr<Node> root;
-    Node* currentDirectory;
+        size_t bytesAfter = nodes->getBytesReserved() + arena->getBytesReserved();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        session.out() << "Compacted " << getNodeCount() << " nodes in " << seconds << " s (" << bytesBefore
+                      << " -> " << bytesAfter << " bytes reserved)." << '\n';
+    }
 
-    // Helper function to split a path string by '/'
-    std::vector<std::string> splitPath(const std::string& path) {
-        std::vector<std::string> parts;
-        std::stringstream ss(path);
-        std::string part;
-        while (std::getline(ss, part, '/')) {
-            if (!part.empty()) {
-                parts.push_back(part);
-            }
+    // Replace the tree with a read-only copy that takes a few bytes per node
+    // (freeze), for replicas that only serve lookups. cd, ls, pwd and find
+    // keep working on the copy; everything that would change the tree is
+    // refused from then on. Waits for every other session's command to
+    // finish first; sessions stay in their directories.
+    void freeze(Session& session) {
+        std::unique_lock<ReadWriteLock> tree(treeLock);
+        if (refuseIfFrozen(session)) {
+            return;
         }
-        return parts;
-    }
+        reclaimer.collect();
+        auto start = std::chrono::steady_clock::now();
+        size_t bytesBefore = nodes->getBytesReserved() + arena->getBytesReserved() + names.getMemoryUsage() +
+                             nodesByName.getCapacity() * sizeof(std::atomic<NodeId>);
+        frozenTree = std::make_unique<FrozenTree>(*nodes, root, names);
 
-    // Helper function to check if a name is valid (no '/' characters)
-    bool isValidName(const std::string& name) {
-        return name.find('/') == std::string::npos;
-    }
+        // Lookups are held back from here until swapTree lets them go, so
+        // none sees the frozen copy with a working directory in the old tree
+        replacing.store(true, std::memory_order_seq_cst);
+        Epochs::synchronize();
+        frozen.store(frozenTree.get(), std::memory_order_release);
+        // The mutable tree goes with 'released'
+        FileSystem released;
+        swapTree(released);
 
-    // Helper function to check if a name already exists in current directory
-    bool nameExists(const std::string& name) {
-        return currentDirectory->children.count(name) > 0;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        session.out() << "Froze " << frozenTree->size() << " nodes in " << seconds << " s (" << bytesBefore
+                      << " -> " << frozenTree->getMemoryUsage() << " bytes)." << '\n';
     }
 
-    // Helper function to navigate to a node by path parts
-    Node* navigateToPath(const std::vector<std::string>& parts, Node* startNode) {
-        Node* targetNode = startNode;
-        
-        for (const auto& part : parts) {
-            if (part == "..") {
-                if (targetNode->parent != nullptr) {
-                    targetNode = targetNode->parent;
+    // Copy a directory tree from the host file system into a directory of
+    // this one (import). Host directories are read on 'threadCount' threads,
+    // one task per directory; a task lists its whole directory first and
+    // then inserts the batch holding only that directory's lock, once per
+    // directory rather than once per entry. Existing directories are merged
+    // into; names already taken by a different kind of node are skipped, and
+    // so are the entries of a directory another session removes while it is
+    // being read. Each is counted and reported apart.
+    void import(Session& session, const std::string& hostPath, std::string_view virtualPath, size_t threadCount) {
+        std::shared_lock<ReadWriteLock> tree(treeLock);
+        if (refuseIfFrozen(session)) {
+            return;
+        }
+        ReadSection section(*this);
+        NodeId target = workingDirectory(session);
+        if (!virtualPath.empty()) {
+            target = navigateToPath(virtualPath, virtualPath[0] == '/' ? root : target);
+            if (target == NO_NODE) {
+                session.out() << "Error: Invalid path '" << virtualPath << "'." << '\n';
+                return;
+            }
+        }
+        std::unique_ptr<HostDirectory> top = HostDirectory::open(hostPath);
+        if (top == nullptr) {
+            session.out() << "Error: Cannot open directory '" << hostPath << "'." << '\n';
+            return;
+        }
+
+        // A task is a host directory still to be read. It is opened through
+        // its parent, which stays open until all of its subdirectories have
+        // been opened.
+        struct ImportTask {
+            NodeId directory = NO_NODE;
+            std::shared_ptr<const HostDirectory> parent;
+            std::string name;
+            std::unique_ptr<HostDirectory> opened; // Set for the top directory only
+        };
+
+        std::atomic<size_t> importedDirectories{0};
+        std::atomic<size_t> importedFiles{0};
+        std::atomic<size_t> clashed{0};
+        std::atomic<size_t> orphaned{0}; // Read from directories removed meanwhile
+        std::atomic<size_t> unreadable{0};
+
+        WorkStealingScheduler<ImportTask> scheduler(
+            threadCount != 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency()));
+        ImportTask first;
+        first.directory = target;
+        first.opened = std::move(top);
+        scheduler.push(0, std::move(first));
+        scheduler.run([&](ImportTask& task, size_t worker) {
+            std::unique_ptr<HostDirectory> host =
+                task.opened != nullptr ? std::move(task.opened) : task.parent->openChild(task.name);
+            task.parent.reset();
+            std::string entryNames;
+            std::vector<HostEntry> entries;
+            if (host == nullptr || !host->read(entryNames, entries)) {
+                unreadable.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            std::vector<std::pair<NodeId, const HostEntry*>> subdirectories;
+            {
+                NodeId directory = task.directory;
+                std::lock_guard<ReadWriteLock> lock(lockFor(directory));
+                if (nodes->removed(directory).load(std::memory_order_acquire)) {
+                    // Removed by another session while it was being read
+                    orphaned.fetch_add(entries.size(), std::memory_order_relaxed);
+                    return;
                 }
-            } else if (part != ".") {
-                if (targetNode->type != NodeType::DIRECTORY) {
-                    return nullptr; // Not a directory
-                }
-                if (targetNode->children.count(part)) {
-                    Node* child = targetNode->children[part].get();
-                    if (child->type == NodeType::DIRECTORY) {
-                        targetNode = child;
-                    } else {
-                        return nullptr; // Not a directory
+                DirectoryEntries& children = nodes->children(directory);
+                children.reserve(children.size() + entries.size(), *arena, reclaimer);
+                for (const HostEntry& entry : entries) {
+                    std::string_view name(entryNames.data() + entry.nameOffset, entry.nameLength);
+                    NodeType type = entry.directory ? NodeType::DIRECTORY : NodeType::FILE;
+                    NameId id = names.intern(name, reclaimer);
+                    auto slot = children.tryEmplace(id, *arena, reclaimer);
+                    NodeId node;
+                    if (slot.second) {
+                        node = createNode(id, type, directory);
+                        slot.first->store(node, std::memory_order_release);
+                        (entry.directory ? importedDirectories : importedFiles).fetch_add(1, std::memory_order_relaxed);
+                    } else if (NodeTable::type(node = slot.first->load(std::memory_order_relaxed)) != type) {
+                        clashed.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                    if (entry.directory) {
+                        subdirectories.emplace_back(node, &entry);
                     }
-                } else {
-                    return nullptr; // Path not found
                 }
             }
+
+            std::shared_ptr<const HostDirectory> parent(std::move(host));
+            for (const auto& subdirectory : subdirectories) {
+                ImportTask child;
+                child.directory = subdirectory.first;
+                child.parent = parent;
+                child.name.assign(entryNames, subdirectory.second->nameOffset, subdirectory.second->nameLength);
+                scheduler.push(worker, std::move(child));
+            }
+        });
+
+        session.out() << "Imported " << (importedDirectories + importedFiles) << " entries from '" << hostPath
+                      << "' (" << importedDirectories << " directories, " << importedFiles << " files)." << '\n';
+        if (clashed != 0) {
+            session.out() << "Warning: " << clashed << " entries clashed with existing names and were skipped."
+                          << '\n';
+        }
+        if (orphaned != 0) {
+            session.out() << "Warning: " << orphaned
+                          << " entries were dropped because their directory was removed while being read." << '\n';
+        }
+        if (unreadable != 0) {
+            session.out() << "Warning: " << unreadable << " directories could not be read." << '\n';
+        }
+        // One snapshot is far cheaper than journaling every imported node
+        if (journal != nullptr && importedDirectories + importedFiles != 0) {
+            compactJournal(session.out());
         }
-        return targetNode;
     }
 
-    // Helper for the 'find' command (recursive traversal)
-    void find_helper(Node* startNode, const std::string& targetName, std::vector<std::string>& results) {
-        // Check if the current node's name matches the target
-        if (startNode->name == targetName) {
-            results.push_back(getPath(startNode));
+    // Write the tree to a file as JSON (export). By default each node is one
+    // NDJSON line with its full path; with 'nested' the file is a single
+    // JSON document where directories hold their children. Either way the
+    // tree is walked depth-first with an explicit stack and the current
+    // path is kept, already escaped, in one buffer that grows and shrinks
+    // by one name per step, so memory stays proportional to the tree's
+    // depth and the output buffer no matter how many nodes are written.
+    // Children are written in index order, not sorted.
+    void exportTree(Session& session, const std::string& fileName, bool nested) {
+        std::shared_lock<ReadWriteLock> tree(treeLock);
+        if (refuseIfFrozen(session)) {
+            return;
+        }
+        FILE* out = std::fopen(fileName.c_str(), "wb");
+        if (out == nullptr) {
+            session.out() << "Error: Cannot open '" << fileName << "' for writing." << '\n';
+            return;
         }
+        WholeTreeReadLock treeShape(*this);
+        constexpr size_t FLUSH_THRESHOLD = 1 << 20;
+        auto start = std::chrono::steady_clock::now();
+        std::string buffer;
+        buffer.reserve(FLUSH_THRESHOLD + 4096);
+        uint64_t bytesWritten = 0;
+        size_t nodesWritten = 0;
+        bool failed = false;
+        auto flush = [&]() {
+            failed |= std::fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size();
+            bytesWritten += buffer.size();
+            buffer.clear();
+        };
 
-        // If it's a directory, recurse on its children
-        if (startNode->type == NodeType::DIRECTORY) {
-            for (auto it = startNode->children.begin(); it != startNode->children.end(); ++it) {
-                find_helper(it->second.get(), targetName, results);
+        std::string path;                // Escaped path of the node being written
+        std::vector<size_t> pathLengths; // Length of 'path' for each open directory
+        bool firstSibling = true;
+        auto enter = [&](const TreeWalker::Entry& entry, size_t depth) {
+            bool directory = NodeTable::isDirectory(entry.node);
+            pathLengths.resize(depth);
+            if (depth != 0) {
+                path.resize(pathLengths.back());
+                path += '/';
+                appendJsonEscaped(path, names.get(entry.name));
+            }
+            const char* type = directory ? "directory" : "file";
+            if (!nested) {
+                buffer += "{\"path\":\"";
+                buffer += path.empty() ? "/" : path;
+                buffer += "\",\"type\":\"";
+                buffer += type;
+                buffer += "\"}\n";
+            } else {
+                if (!firstSibling) {
+                    buffer += ',';
+                }
+                buffer += "{\"name\":\"";
+                appendJsonEscaped(buffer, entry.node == root ? std::string_view("/") : names.get(entry.name));
+                buffer += "\",\"type\":\"";
+                buffer += type;
+                buffer += directory ? "\",\"children\":[" : "\"}";
+            }
+            ++nodesWritten;
+            if (buffer.size() >= FLUSH_THRESHOLD) {
+                flush();
             }
+            pathLengths.push_back(path.size());
+            firstSibling = directory;
+            return true;
+        };
+        auto leave = [&](const TreeWalker::Entry& entry, size_t) {
+            if (NodeTable::isDirectory(entry.node)) {
+                if (nested) {
+                    buffer += "]}";
+                }
+                firstSibling = false;
+            }
+        };
+        TreeWalker::depthFirst(*nodes, root, enter, leave);
+        if (nested) {
+            buffer += '\n';
+        }
+        flush();
+        failed |= std::fclose(out) != 0;
+        if (failed) {
+            session.out() << "Error: Failed writing '" << fileName << "'." << '\n';
+            return;
         }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        session.out() << "Exported " << nodesWritten << " nodes (" << bytesWritten << " bytes) to '" << fileName
+                      << "' in " << seconds << " s (" << (seconds > 0 ? bytesWritten / seconds / 1e6 : 0.0)
+                      << " MB/s)." << '\n';
     }
 
+    // Persist the tree under a data directory: the last snapshot there is
+    // loaded, the journal written since is replayed on top of it, and from
+    // then on every mkdir and touch is appended to the journal. Returns
+    // false if the directory held no earlier state.
+    bool openJournal(const std::string& directory) {
+        dataDirectory = directory;
+        std::error_code error;
+        std::filesystem::create_directories(dataDirectory, error);
 
-public:
-    FileSystem() {
-        // The root directory has no parent
-        root = std::make_unique<Node>("/", NodeType::DIRECTORY, nullptr);
-        currentDirectory = root.get();
+        bool restored = false;
+        std::string message;
+        if (std::filesystem::exists(snapshotPath(), error)) {
+            if (!readSnapshot(snapshotPath(), message)) {
+                std::cout << "Error: " << message << '\n';
+            } else {
+                restored = true;
+            }
+        }
+
+        size_t replayed = 0;
+        {
+            MappedFile log(journalPath());
+            if (log.isOpen() && log.size() > 0) {
+                restored = true;
+                size_t intact = Journal::replay(log.getData(), log.size(),
+                    [&](Journal::Operation operation, std::string_view nodePath) {
+                        replayMutation(operation, nodePath);
+                        ++replayed;
+                    });
+                if (intact != log.size()) {
+                    std::cout << "Warning: Discarding " << (log.size() - intact)
+                              << " bytes of incomplete journal records." << '\n';
+                    std::filesystem::resize_file(journalPath(), intact, error);
+                }
+            }
+        }
+        if (restored) {
+            std::cout << "Restored " << getNodeCount() << " nodes from '" << dataDirectory << "' ("
+                      << replayed << " journal records replayed)." << '\n';
+        }
+
+        journal = std::make_unique<Journal>(journalPath());
+        if (!journal->isOpen()) {
+            std::cout << "Error: Cannot open journal '" << journalPath() << "'." << '\n';
+            journal.reset();
+        } else if (replayed > 0) {
+            // Start the new session from a snapshot so replay stays short
+            std::shared_lock<ReadWriteLock> tree(treeLock);
+            compactJournal(std::cout);
+        }
+        return restored;
     }
 
-    ~FileSystem() {
-        // Smart pointers handle cleanup automatically
+    bool hasUncommittedChanges() {
+        if (journal == nullptr) {
+            return false;
+        }
+        std::lock_guard<std::mutex> journalLock(journalMutex);
+        return journal->hasPending();
     }
-      // Get the full path of a given node
-    std::string getPath(Node* node) {
-        if (node == root.get()) {
-            return "/";
+
+    // Make all journaled mutations durable now rather than at the next
+    // group commit
+    void commitJournal() {
+        if (journal != nullptr) {
+            std::lock_guard<std::mutex> journalLock(journalMutex);
+            journal->commit();
         }
-        // Recurse up to the parent and build the path backwards
-        if (node->parent == root.get()) {
-            return "/" + node->name;
+    }
+
+    // Runs 'read' while the shape of the tree is held still: lookups carry on,
+    // but creations, removals and load wait until it returns. Used to run
+    // a batch of read-only commands on several threads against one
+    // consistent tree. 'read' must not create or remove anything itself.
+    template <typename Read>
+    void withStableTree(Read read) {
+        std::shared_lock<ReadWriteLock> tree(treeLock);
+        WholeTreeReadLock treeShape(*this);
+        read();
+    }
+
+    // Report how much memory the tree and its indexes are using (stats)
+    void stats(Session& session) {
+        // Removed nodes still count until they are freed
+        reclaimer.collect();
+        std::shared_lock<ReadWriteLock> tree(treeLock);
+        if (const FrozenTree* frozenCopy = frozen.load(std::memory_order_acquire)) {
+            size_t nodeCount = frozenCopy->size();
+            const FrontCodedNames& frozenNames = frozenCopy->getNames();
+            size_t totalBytes = frozenCopy->getMemoryUsage();
+            session.out() << "Nodes:          " << nodeCount << " (" << frozenCopy->getDirectoryCount()
+                          << " directories, " << nodeCount - frozenCopy->getDirectoryCount() << " files, frozen)"
+                          << '\n';
+            session.out() << "Distinct names: " << frozenNames.size() << " (" << frozenNames.getCharacterBytes()
+                          << " characters)" << '\n';
+            session.out() << "Tree shape:     " << frozenCopy->getShapeBytes() << " bytes (LOUDS and type bits)"
+                          << '\n';
+            session.out() << "Name ids:       " << frozenCopy->getNameIdBytes() << " bytes ("
+                          << frozenCopy->getNameIdBits() << " bits/node)" << '\n';
+            session.out() << "Name table:     " << frozenNames.getMemoryUsage() << " bytes (front-coded)" << '\n';
+            session.out() << "Total:          " << totalBytes << " bytes ("
+                          << static_cast<double>(totalBytes) / nodeCount << " bytes/node)" << '\n';
+            return;
         }
-        return getPath(node->parent) + "/" + node->name;
+        WholeTreeReadLock treeShape(*this);
+        std::shared_lock<ReadWriteLock> index(indexLock);
+        size_t nodeCount = getNodeCount();
+        size_t nodeBytes = nodes->getMemoryUsage();
+        size_t childBytes = arena->getBytesUsed();
+        size_t nameBytes = names.getMemoryUsage();
+        size_t indexBytes = nodesByName.getCapacity() * sizeof(std::atomic<NodeId>);
+        size_t totalBytes = nodeBytes + childBytes + nameBytes + indexBytes;
+        size_t reservedBytes = nodes->getBytesReserved() + arena->getBytesReserved() + nameBytes + indexBytes;
+
+        session.out() << "Nodes:          " << nodeCount << " (" << directoryCount << " directories, "
+                      << fileCount << " files)" << '\n';
+        session.out() << "Distinct names: " << names.size() << " (" << names.getCharacterBytes()
+                      << " characters)" << '\n';
+        session.out() << "Node storage:   " << nodeBytes << " bytes (" << NodeTable::FILE_ROW_BYTES
+                      << " bytes/file, " << NodeTable::DIRECTORY_ROW_BYTES << " bytes/directory)" << '\n';
+        session.out() << "Child index:    " << childBytes << " bytes" << '\n';
+        session.out() << "Name table:     " << nameBytes << " bytes ("
+                      << NameKernels::levelName(NameKernels::currentLevel()) << " search kernels)" << '\n';
+        session.out() << "Name index:     " << indexBytes << " bytes" << '\n';
+        session.out() << "Total:          " << totalBytes << " bytes (" << totalBytes / nodeCount
+                      << " bytes/node, " << reservedBytes << " reserved)" << '\n';
     }
+};
 
+// --- Main function to run the command-line interface ---
 
-    // Print Working Directory (pwd)
-    void pwd() {
-        std::cout << getPath(currentDirectory) << std::endl;
-    }    // List contents (ls)
-    void ls() {
-        for (auto it = currentDirectory->children.begin(); it != currentDirectory->children.end(); ++it) {
-            std::cout << it->first;
-            if (it->second->type == NodeType::DIRECTORY) {
-                std::cout << "/";
+// Strips one pair of matching surrounding quotes, as a shell would
+std::string_view unquote(std::string_view argument) {
+    if (argument.size() >= 2 && (argument.front() == '\'' || argument.front() == '"') &&
+        argument.back() == argument.front()) {
+        return argument.substr(1, argument.size() - 2);
+    }
+    return argument;
+}
+
+// True when no more input is waiting, i.e. the next read may block. Journaled
+// mutations are committed at that point so an interactive session never
+// leaves them unsynced while it waits; scripted input keeps streaming and is
+// committed in groups instead. Input redirected from a regular file never
+// waits, so it is not polled at all.
+bool input_idle() {
+#ifdef _WIN32
+    return true;
+#else
+    static const bool fromFile = [] {
+        struct stat info;
+        return ::fstat(STDIN_FILENO, &info) == 0 && S_ISREG(info.st_mode);
+    }();
+    if (fromFile) {
+        return false;
+    }
+    pollfd input{STDIN_FILENO, POLLIN, 0};
+    return ::poll(&input, 1, 0) == 0;
+#endif
+}
+
+void show_help(std::ostream& out);
+
+// Parses a positive count such as the thread count of 'find -j'
+bool parse_count(std::string_view text, size_t& count) {
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), count);
+    return !text.empty() && parsed.ec == std::errc() && parsed.ptr == text.data() + text.size() && count != 0;
+}
+
+// One REPL command. Every command is described once in COMMANDS below; the
+// dispatcher and the help text are both built from that table, so adding a
+// command means adding one entry.
+struct CommandDescriptor {
+    std::string_view name;
+    std::string_view synopsis;    // Shown in the help listing
+    std::string_view usage;       // Shown when required arguments are missing
+    std::string_view description;
+    std::string_view details;     // Extra help lines (options), may be empty
+    size_t requiredArguments;
+    // Changes neither the tree nor the session, so it may run alongside
+    // other such commands from the same session
+    bool readOnly;
+    // Runs the command with its first argument and the rest of the line;
+    // returns false once the session should end
+    bool (*run)(FileSystem& fs, Session& session, std::string_view argument, CommandTokenizer& rest);
+};
+
+constexpr CommandDescriptor COMMANDS[] = {
+    {"ls", "ls", "ls", "List contents of the current directory", "", 0, true,
+     [](FileSystem& fs, Session& session, std::string_view, CommandTokenizer&) { fs.ls(session); return true; }},
+    {"mkdir", "mkdir <name>", "mkdir <name>", "Create a new directory", "", 1, false,
+     [](FileSystem& fs, Session& session, std::string_view name, CommandTokenizer&) { fs.mkdir(session, name); return true; }},
+    {"touch", "touch <name>", "touch <name>", "Create a new empty file", "", 1, false,
+     [](FileSystem& fs, Session& session, std::string_view name, CommandTokenizer&) { fs.touch(session, name); return true; }},
+    {"rm", "rm <path>", "rm [-r] <path>", "Remove a file or empty directory",
+     "    -r               - Remove a directory and everything below it\n",
+     1, false,
+     [](FileSystem& fs, Session& session, std::string_view argument, CommandTokenizer& rest) {
+         bool recursive = argument == "-r";
+         if (recursive) {
+             argument = {};
+             rest.next(argument);
+         }
+         if (argument.empty()) session.out() << "Usage: rm [-r] <path>" << '\n';
+         else fs.rm(session, argument, recursive);
+         return true;
+     }},
+    {"cd", "cd <path>", "cd <path>", "Change directory (e.g., 'cd /', 'cd ..', 'cd my_folder')", "", 1, false,
+     [](FileSystem& fs, Session& session, std::string_view path, CommandTokenizer&) { fs.cd(session, path); return true; }},
+    {"pwd", "pwd", "pwd", "Print the current working directory path", "", 0, true,
+     [](FileSystem& fs, Session& session, std::string_view, CommandTokenizer&) { fs.pwd(session); return true; }},
+    {"find", "find <name>", "find [-j <threads>] [-name|-regex] <pattern>",
+     "Search for a file or directory from the root",
+     "    -name <pattern>  - Match names against a glob such as '*.txt'\n"
+     "    -regex <pattern> - Match whole names against a regular expression\n"
+     "    -j <n>           - Scan the whole tree with n threads instead of using the index\n",
+     1, true,
+     [](FileSystem& fs, Session& session, std::string_view argument, CommandTokenizer& rest) {
+         FindMode mode = FindMode::EXACT;
+         size_t threads = 0;
+         while (argument == "-j" || argument == "-name" || argument == "-regex") {
+             if (argument == "-j") {
+                 std::string_view count;
+                 rest.next(count);
+                 if (!parse_count(count, threads)) {
+                     argument = {};
+                     break;
+                 }
+             }
+             if (argument == "-name") mode = FindMode::GLOB;
+             if (argument == "-regex") mode = FindMode::REGEX;
+             argument = {};
+             rest.next(argument);
+         }
+         argument = unquote(argument);
+         if (argument.empty()) session.out() << "Usage: find [-j <threads>] [-name|-regex] <pattern>" << '\n';
+         else fs.find(session, std::string(argument), mode, threads);
+         return true;
+     }},
+    {"import", "import <dir>", "import [-j <threads>] <host-path> [<virtual-path>]",
+     "Copy a real directory tree into the current directory",
+     "    <path>           - Copy it into this directory instead (e.g., 'import ~/src /code')\n"
+     "    -j <n>           - Read host directories with n threads\n",
+     1, false,
+     [](FileSystem& fs, Session& session, std::string_view argument, CommandTokenizer& rest) {
+         size_t threads = 0;
+         if (argument == "-j") {
+             std::string_view count;
+             rest.next(count);
+             argument = {};
+             if (parse_count(count, threads)) {
+                 rest.next(argument);
+             }
+         }
+         std::string_view virtualPath;
+         rest.next(virtualPath);
+         argument = unquote(argument);
+         if (argument.empty()) session.out() << "Usage: import [-j <threads>] <host-path> [<virtual-path>]" << '\n';
+         else fs.import(session, std::string(argument), unquote(virtualPath), threads);
+         return true;
+     }},
+    {"export", "export <file>", "export [-json] <file>",
+     "Write every node with its full path to a file as NDJSON",
+     "    -json            - Write one nested JSON document instead\n",
+     1, false,
+     [](FileSystem& fs, Session& session, std::string_view argument, CommandTokenizer& rest) {
+         bool nested = argument == "-json";
+         if (nested) {
+             argument = {};
+             rest.next(argument);
+         }
+         if (argument.empty()) session.out() << "Usage: export [-json] <file>" << '\n';
+         else fs.exportTree(session, std::string(argument), nested);
+         return true;
+     }},
+    {"save", "save <file>", "save <file>", "Save the whole tree to a snapshot file", "", 1, false,
+     [](FileSystem& fs, Session& session, std::string_view file, CommandTokenizer&) { fs.save(session, std::string(file)); return true; }},
+    {"load", "load <file>", "load <file>", "Replace the tree with one from a snapshot file", "", 1, false,
+     [](FileSystem& fs, Session& session, std::string_view file, CommandTokenizer&) { fs.load(session, std::string(file)); return true; }},
+    {"compact", "compact", "compact", "Lay the tree out again in depth-first order", "", 0, false,
+     [](FileSystem& fs, Session& session, std::string_view, CommandTokenizer&) { fs.compact(session); return true; }},
+    {"freeze", "freeze", "freeze", "Make the tree read-only and store it in a few bytes per node", "", 0, false,
+     [](FileSystem& fs, Session& session, std::string_view, CommandTokenizer&) { fs.freeze(session); return true; }},
+    {"stats", "stats", "stats", "Show memory usage of the file system", "", 0, false,
+     [](FileSystem& fs, Session& session, std::string_view, CommandTokenizer&) { fs.stats(session); return true; }},
+    {"help", "help", "help", "Show this help message", "", 0, false,
+     [](FileSystem&, Session& session, std::string_view, CommandTokenizer&) { show_help(session.out()); return true; }},
+    {"exit", "exit", "exit", "Exit the navigator", "", 0, false,
+     [](FileSystem&, Session&, std::string_view, CommandTokenizer&) { return false; }},
+};
+
+constexpr size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+// Perfect hash from command name to COMMANDS index, built at compile time:
+// a seeded FNV-1a hash is tried with increasing seeds until every command
+// lands in its own slot, so a lookup costs one hash and one comparison.
+namespace CommandTable {
+    constexpr size_t SLOT_COUNT = 32;
+    constexpr uint8_t EMPTY = 0xFF;
+
+    static_assert(COMMAND_COUNT < SLOT_COUNT, "Command table is too small");
+
+    constexpr size_t slotOf(std::string_view name, uint32_t seed) {
+        uint32_t hash = 2166136261u ^ seed;
+        for (char c : name) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        return (hash ^ (hash >> 15)) & (SLOT_COUNT - 1);
+    }
+
+    constexpr bool isPerfect(uint32_t seed) {
+        bool used[SLOT_COUNT] = {};
+        for (const auto& command : COMMANDS) {
+            size_t slot = slotOf(command.name, seed);
+            if (used[slot]) {
+                return false;
             }
-            std::cout << std::endl;
+            used[slot] = true;
         }
+        return true;
     }
 
-    // Make Directory (mkdir)
-    void mkdir(const std::string& dirName) {
-        if (!isValidName(dirName)) {
-            std::cout << "Error: Directory name cannot contain '/'." << std::endl;
-            return;
+    constexpr uint32_t findSeed() {
+        for (uint32_t seed = 0; seed < 100000; ++seed) {
+            if (isPerfect(seed)) {
+                return seed;
+            }
         }
-        if (nameExists(dirName)) {
-            std::cout << "Error: '" << dirName << "' already exists." << std::endl;
-        } else {
-            auto newDir = std::make_unique<Node>(dirName, NodeType::DIRECTORY, currentDirectory);
-            currentDirectory->children[dirName] = std::move(newDir);
+        return UINT32_MAX;
+    }
+
+    constexpr uint32_t SEED = findSeed();
+    static_assert(SEED != UINT32_MAX, "No perfect hash seed for the command names");
+
+    constexpr std::array<uint8_t, SLOT_COUNT> buildSlots() {
+        std::array<uint8_t, SLOT_COUNT> slots{};
+        for (auto& slot : slots) {
+            slot = EMPTY;
         }
+        for (size_t i = 0; i < COMMAND_COUNT; ++i) {
+            slots[slotOf(COMMANDS[i].name, SEED)] = static_cast<uint8_t>(i);
+        }
+        return slots;
     }
-    
-    // Create a file (touch)
-    void touch(const std::string& fileName) {
-        if (!isValidName(fileName)) {
-            std::cout << "Error: File name cannot contain '/'." << std::endl;
+
+    constexpr std::array<uint8_t, SLOT_COUNT> SLOTS = buildSlots();
+
+    // Returns the descriptor for a command name, or nullptr if there is none
+    inline const CommandDescriptor* lookup(std::string_view name) {
+        uint8_t index = SLOTS[slotOf(name, SEED)];
+        if (index == EMPTY || COMMANDS[index].name != name) {
+            return nullptr;
+        }
+        return &COMMANDS[index];
+    }
+}
+
+void show_help(std::ostream& out) {
+    // Descriptions line up after the widest ordinary synopsis
+    constexpr size_t SYNOPSIS_WIDTH = 12;
+    out << "File System Navigator Commands:\n";
+    for (const auto& command : COMMANDS) {
+        out << "  " << command.synopsis;
+        for (size_t i = command.synopsis.size(); i < SYNOPSIS_WIDTH; ++i) {
+            out << ' ';
+        }
+        out << "- " << command.description << '\n' << command.details;
+    }
+    out << '\n';
+}
+
+// Runs one command line for a session; returns false once the session
+// should end
+bool run_command(FileSystem& fs, Session& session, std::string_view line) {
+    CommandTokenizer tokens(line);
+    std::string_view name;
+    std::string_view argument;
+    if (!tokens.next(name)) {
+        return true; // Skip empty lines
+    }
+    tokens.next(argument);
+
+    const CommandDescriptor* command = CommandTable::lookup(name);
+    if (command == nullptr) {
+        session.out() << "Unknown command: '" << name << "'. Type 'help' for a list of commands." << '\n';
+        return true;
+    }
+    if (command->requiredArguments > 0 && argument.empty()) {
+        session.out() << "Usage: " << command->usage << '\n';
+        return true;
+    }
+    return command->run(fs, session, argument, tokens);
+}
+
+// True if a command line runs a read-only command (see CommandDescriptor)
+bool is_read_only_command(std::string_view line) {
+    CommandTokenizer tokens(line);
+    std::string_view name;
+    const CommandDescriptor* command = tokens.next(name) ? CommandTable::lookup(name) : nullptr;
+    return command != nullptr && command->readOnly;
+}
+
+// Stream buffer that appends everything written to it to a string
+class StringOutput : public std::streambuf {
+private:
+    std::string* target;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            target->push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* text, std::streamsize count) override {
+        target->append(text, static_cast<size_t>(count));
+        return count;
+    }
+
+public:
+    explicit StringOutput(std::string& target) : target(&target) {}
+};
+
+#ifdef __linux__
+// Serves the command language to clients on a Unix domain socket (--serve).
+// Each connection has its own Session. Clients send command lines, and each
+// command is answered with a line holding the length of its output in bytes
+// followed by exactly that output, so a client can find the end of an
+// answer without knowing the command. 'exit' closes the connection.
+//
+// One thread waits in epoll for new connections and readable sockets and
+// hands ready connections to a pool of workers. Connections are registered
+// with EPOLLONESHOT, so at most one worker owns a connection at a time and
+// its commands run in order. The worker reads everything waiting, runs every
+// complete line, writes the answers and re-arms the connection. Nothing more
+// is read from a client that stops reading its answers until they drain.
+//
+// Clients may pipeline: send many commands without waiting, and the answers
+// come back in order in as few writes as possible. When a pipeline holds a
+// run of at least 2 * PARALLEL_GROUP read-only commands (ls, pwd, find) and
+// there is more than one CPU, the run is executed as a ReadGroup. The tree
+// is held stable (no writer may change it) for the group's duration and
+// idle workers help run its commands, one helper per PARALLEL_GROUP
+// commands, each on a copy of the session. The answers are the same as if
+// the commands had run one by one in a moment when nobody else was writing.
+class CommandServer {
+private:
+    static constexpr size_t READ_SIZE = 1 << 16;     // Bytes read per recv()
+    static constexpr size_t READ_LIMIT = 1 << 18;    // Bytes read per turn, for fairness
+    static constexpr size_t MAX_LINE = 1 << 16;      // Longest accepted command line
+    static constexpr size_t OUTPUT_LIMIT = 1 << 20;  // Unsent answer bytes before reading stops
+    static constexpr int MAX_EVENTS = 256;
+    static constexpr size_t PARALLEL_GROUP = 8;      // Commands per helper in a ReadGroup
+
+    struct Connection {
+        int fd;
+        std::string input;
+        std::string output;
+        size_t outputSent = 0;
+        bool peerClosed = false; // The client has shut down its side
+        bool closing = false;    // 'exit' was run
+        // Held for a whole turn, re-arming included. epoll can hand the
+        // connection to the next worker before the last one has returned
+        // from re-arming it, so the next turn starts by waiting here; this
+        // also orders each turn after the one before.
+        std::mutex turn;
+        std::string answer;      // Output of the command being run
+        StringOutput answerBuffer{answer};
+        std::ostream answerStream{&answerBuffer};
+        Session session{answerStream};
+
+        explicit Connection(int fd) : fd(fd) {}
+    };
+
+    // A run of read-only commands from one connection. Workers claim
+    // commands one at a time and leave each answer in its own slot.
+    struct ReadGroup {
+        const Session* origin;
+        std::vector<std::string_view> lines;
+        std::vector<std::string> answers;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> remaining{0};
+    };
+
+    // Work for a worker: a connection that is ready, or a group to help with
+    struct Job {
+        Connection* connection;
+        std::shared_ptr<ReadGroup> group;
+    };
+
+    FileSystem& fs;
+    size_t cpuCount;
+    // Workers that may help with a group besides the one that owns it.
+    // Helpers beyond the number of CPUs could only slow a group down.
+    size_t helperLimit = 0;
+    int epollFd = -1;
+    int listenFd = -1;
+    int signalFd = -1;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<Job> ready;
+    bool stopping = false;
+
+    std::mutex connectionsMutex;
+    std::unordered_set<Connection*> connections;
+
+    void accept() {
+        while (true) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return; // EAGAIN, or out of descriptors until a client leaves
+            }
+            Connection* connection = new Connection(fd);
+            {
+                std::lock_guard<std::mutex> lock(connectionsMutex);
+                connections.insert(connection);
+            }
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            event.data.ptr = connection;
+            if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                close(connection);
+            }
+        }
+    }
+
+    void close(Connection* connection) {
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            connections.erase(connection);
+        }
+        ::close(connection->fd);
+        delete connection;
+    }
+
+    // Sends as much pending output as the socket takes; false on error
+    static bool flush(Connection& connection) {
+        while (connection.outputSent < connection.output.size()) {
+            ssize_t sent = ::send(connection.fd, connection.output.data() + connection.outputSent,
+                                  connection.output.size() - connection.outputSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            connection.outputSent += static_cast<size_t>(sent);
+        }
+        connection.output.clear();
+        connection.outputSent = 0;
+        return true;
+    }
+
+    // Reads what the client has sent, up to READ_LIMIT; false on error
+    static bool receive(Connection& connection) {
+        size_t total = 0;
+        while (total < READ_LIMIT) {
+            size_t used = connection.input.size();
+            connection.input.resize(used + READ_SIZE);
+            ssize_t received = ::recv(connection.fd, &connection.input[used], READ_SIZE, MSG_DONTWAIT);
+            connection.input.resize(used + static_cast<size_t>(std::max<ssize_t>(received, 0)));
+            if (received > 0) {
+                total += static_cast<size_t>(received);
+            } else if (received == 0) {
+                connection.peerClosed = true;
+                return true;
+            } else if (errno != EINTR) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+        }
+        return true;
+    }
+
+    // Queues the output of the last command, framed by its length
+    static void sendAnswer(Connection& connection) {
+        char header[24];
+        auto written = std::to_chars(header, header + sizeof(header) - 1, connection.answer.size());
+        *written.ptr++ = '\n';
+        connection.output.append(header, written.ptr);
+        connection.output += connection.answer;
+        connection.answer.clear();
+    }
+
+    // Claims and runs commands of a group until none are left. A helper
+    // may arrive after the group is done and its connection gone, so
+    // nothing but the counter is touched until a claim succeeds.
+    void helpWith(ReadGroup& group) {
+        size_t index = group.next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= group.lines.size()) {
             return;
         }
-        if (nameExists(fileName)) {
-            std::cout << "Error: '" << fileName << "' already exists." << std::endl;
-        } else {
-            auto newFile = std::make_unique<Node>(fileName, NodeType::FILE, currentDirectory);
-            currentDirectory->children[fileName] = std::move(newFile);
+        std::string answer;
+        StringOutput answerBuffer(answer);
+        std::ostream answerStream(&answerBuffer);
+        Session session(*group.origin, answerStream);
+        do {
+            run_command(fs, session, group.lines[index]);
+            group.answers[index].swap(answer);
+            answer.clear();
+            group.remaining.fetch_sub(1, std::memory_order_release);
+        } while ((index = group.next.fetch_add(1, std::memory_order_relaxed)) < group.lines.size());
+    }
+
+    // Runs a group of read-only commands with the help of idle workers and
+    // queues their answers in order
+    void runGroup(Connection& connection, const std::vector<std::string_view>& lines) {
+        auto group = std::make_shared<ReadGroup>();
+        group->origin = &connection.session;
+        group->lines = lines;
+        group->answers.resize(group->lines.size());
+        group->remaining.store(group->lines.size(), std::memory_order_relaxed);
+        fs.withStableTree([&] {
+            size_t helpers = std::min(helperLimit, group->lines.size() / PARALLEL_GROUP - 1);
+            if (helpers != 0) {
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    for (size_t i = 0; i < helpers; ++i) {
+                        ready.push_back({nullptr, group});
+                    }
+                }
+                queueReady.notify_all();
+            }
+            helpWith(*group);
+            while (group->remaining.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+        });
+        for (std::string& answer : group->answers) {
+            connection.answer.swap(answer);
+            sendAnswer(connection);
         }
     }
-    // Change Directory (cd)
-    void cd(const std::string& path) {
-        if (path == "/") {
-            currentDirectory = root.get();
+
+    // Runs the complete lines received so far, stopping early if the
+    // answers pile up
+    void runCommands(Connection& connection) {
+        size_t consumed = 0;
+        std::vector<std::string_view> reads; // Read-only commands not yet run
+        while (true) {
+            bool more = !connection.closing && connection.output.size() - connection.outputSent < OUTPUT_LIMIT;
+            size_t end = more ? connection.input.find('\n', consumed) : std::string::npos;
+            if (more && end == std::string::npos && connection.peerClosed && consumed != connection.input.size()) {
+                // A client that hangs up ends its last line implicitly
+                end = connection.input.size();
+            }
+            std::string_view line;
+            if (end != std::string::npos) {
+                line = std::string_view(connection.input.data() + consumed, end - consumed);
+                consumed = std::min(end + 1, connection.input.size());
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                if (helperLimit != 0 && is_read_only_command(line)) {
+                    reads.push_back(line);
+                    continue;
+                }
+            }
+            // The run of reads has ended; share it out if it is long enough
+            if (reads.size() >= 2 * PARALLEL_GROUP) {
+                runGroup(connection, reads);
+                reads.clear();
+            }
+            for (std::string_view read : reads) {
+                run_command(fs, connection.session, read);
+                sendAnswer(connection);
+            }
+            reads.clear();
+            if (end == std::string::npos) {
+                break;
+            }
+            connection.closing = !run_command(fs, connection.session, line);
+            sendAnswer(connection);
+        }
+        connection.input.erase(0, consumed);
+        // Complete lines left over because output backed up run on a later
+        // turn; only the unfinished line at the end can be too long
+        size_t lastEnd = connection.input.rfind('\n');
+        size_t unfinished = connection.input.size() - (lastEnd == std::string::npos ? 0 : lastEnd + 1);
+        if (unfinished > MAX_LINE) {
+            connection.session.out() << "Error: Command line exceeds " << MAX_LINE << " bytes." << '\n';
+            sendAnswer(connection);
+            connection.input.clear();
+            connection.closing = true;
+        }
+    }
+
+    // One turn of a ready connection on a worker. Either re-arms it or
+    // closes it; the worker must not touch it afterwards.
+    void serve(Connection* connection) {
+        std::unique_lock<std::mutex> turn(connection->turn);
+        bool healthy = flush(*connection);
+        if (healthy && !connection->closing && !connection->peerClosed &&
+            connection->output.size() < OUTPUT_LIMIT) {
+            healthy = receive(*connection);
+        }
+        if (healthy) {
+            runCommands(*connection);
+            healthy = flush(*connection);
+        }
+        bool unsent = !connection->output.empty();
+        bool finished = connection->closing || (connection->peerClosed && connection->input.empty());
+        // Lines that runCommands left for later because output backed up
+        bool waiting = !connection->closing && (connection->input.find('\n') != std::string::npos ||
+                                                (connection->peerClosed && !connection->input.empty()));
+        if (!healthy || (finished && !unsent)) {
+            turn.unlock();
+            close(connection);
             return;
         }
+        epoll_event event{};
+        event.events = EPOLLONESHOT | EPOLLRDHUP;
+        if (!finished && !connection->peerClosed && connection->output.size() < OUTPUT_LIMIT) {
+            event.events |= EPOLLIN;
+        }
+        if (unsent || waiting) {
+            // A writable socket reports ready at once, so waiting lines
+            // resume on the next turn even when everything has been sent
+            event.events |= EPOLLOUT;
+        }
+        event.data.ptr = connection;
+        if (::epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event) != 0) {
+            // Not armed, so nobody else can have picked it up
+            turn.unlock();
+            close(connection);
+        }
+    }
 
-        Node* targetNode = (path[0] == '/') ? root.get() : currentDirectory;
-        std::vector<std::string> parts = splitPath(path);
+    void work() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueReady.wait(lock, [this] { return stopping || !ready.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = std::move(ready.front());
+                ready.pop_front();
+            }
+            if (job.group != nullptr) {
+                helpWith(*job.group);
+            } else {
+                serve(job.connection);
+            }
+        }
+    }
 
-        targetNode = navigateToPath(parts, targetNode);
-        if (targetNode != nullptr) {
-            currentDirectory = targetNode;
-        } else {
-            std::cout << "Error: Invalid path '" << path << "'." << std::endl;
+    // Creates the listening socket, replacing a stale socket file left by
+    // a server that is no longer running
+    bool listen(const std::string& socketPath) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            std::cout << "Error: Socket path '" << socketPath << "' is too long." << '\n';
+            return false;
         }
-    }    // Find a file or directory by name
-    void find(const std::string& name) {
-        std::vector<std::string> results;
-        find_helper(root.get(), name, results);
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            std::cout << "Error: Cannot create socket: " << std::strerror(errno) << '\n';
+            return false;
+        }
+        struct stat info;
+        if (::stat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool live = ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+            ::close(probe);
+            if (live) {
+                std::cout << "Error: Another server is listening on '" << socketPath << "'." << '\n';
+                return false;
+            }
+            ::unlink(socketPath.c_str());
+        }
+        if (::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd, SOMAXCONN) != 0) {
+            std::cout << "Error: Cannot listen on '" << socketPath << "': " << std::strerror(errno) << '\n';
+            return false;
+        }
+        return true;
+    }
 
-        if (results.empty()) {
-            std::cout << "No file or directory named '" << name << "' found." << std::endl;
-        } else {
-            for (const auto& path : results) {
-                std::cout << path << std::endl;
+public:
+    // 'cpuCount' bounds how many workers share a ReadGroup; the server test
+    // raises it to run groups on a machine with a single CPU
+    explicit CommandServer(FileSystem& fs, size_t cpuCount = std::max(1u, std::thread::hardware_concurrency()))
+        : fs(fs), cpuCount(std::max<size_t>(1, cpuCount)) {}
+
+    CommandServer(const CommandServer&) = delete;
+    CommandServer& operator=(const CommandServer&) = delete;
+
+    ~CommandServer() {
+        for (Connection* connection : connections) {
+            ::close(connection->fd);
+            delete connection;
+        }
+        for (int fd : {epollFd, listenFd, signalFd}) {
+            if (fd >= 0) {
+                ::close(fd);
             }
         }
     }
 
-    // Get the current directory node (for prompt display)
-    Node* getCurrentDirectory() {
-        return currentDirectory;
+    // Serves clients on 'workerCount' threads until SIGINT or SIGTERM;
+    // returns false if the server could not be started
+    bool run(const std::string& socketPath, size_t workerCount) {
+        helperLimit = std::min(workerCount, cpuCount) - 1;
+        // Blocked in every thread and read through signalfd instead
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        ::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        signalFd = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (signalFd < 0 || epollFd < 0 || !listen(socketPath)) {
+            return false;
+        }
+        for (int* fd : {&listenFd, &signalFd}) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = fd;
+            ::epoll_ctl(epollFd, EPOLL_CTL_ADD, *fd, &event);
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+        std::cout << "Serving on '" << socketPath << "' with " << workerCount << " workers." << std::endl;
+
+        epoll_event events[MAX_EVENTS];
+        bool running = true;
+        while (running) {
+            // Wake up at least once per group-commit interval, and commit
+            // the journal whenever no client has anything to say
+            int count = ::epoll_wait(epollFd, events, MAX_EVENTS, static_cast<int>(Journal::COMMIT_INTERVAL.count()));
+            if (count <= 0) {
+                if (fs.hasUncommittedChanges()) {
+                    fs.commitJournal();
+                }
+                continue;
+            }
+            size_t readyCount = 0;
+            for (int i = 0; i < count; ++i) {
+                if (events[i].data.ptr == &listenFd) {
+                    accept();
+                } else if (events[i].data.ptr == &signalFd) {
+                    running = false;
+                } else {
+                    events[readyCount++] = events[i];
+                }
+            }
+            if (readyCount != 0) {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                for (size_t i = 0; i < readyCount; ++i) {
+                    ready.push_back({static_cast<Connection*>(events[i].data.ptr), nullptr});
+                }
+            }
+            if (readyCount == 1) {
+                queueReady.notify_one();
+            } else if (readyCount > 1) {
+                queueReady.notify_all();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        ::unlink(socketPath.c_str());
+        fs.commitJournal();
+        std::cout << "Server stopped." << '\n';
+        return true;
     }
 };
+#endif
 
-// --- Main function to run the command-line interface ---
-void show_help() {
-    std::cout << "File System Navigator Commands:\n"
-              << "  ls          - List contents of the current directory\n"
-              << "  mkdir <name>- Create a new directory\n"
-              << "  touch <name>- Create a new empty file\n"
-              << "  cd <path>   - Change directory (e.g., 'cd /', 'cd ..', 'cd my_folder')\n"
-              << "  pwd         - Print the current working directory path\n"
-              << "  find <name> - Search for a file or directory from the root\n"
-              << "  help        - Show this help message\n"
-              << "  exit        - Exit the navigator\n"
-              << std::endl;
-}
-
-int main() {
+int main(int argc, char* argv[]) {
     FileSystem fs;
+    Session session(std::cout);
     std::string line;
-    std::string command;
-    std::string argument;
-
-    // Create a sample directory structure for demonstration
-    fs.mkdir("home");
-    fs.cd("home");
-    fs.mkdir("user");
-    fs.touch("readme.txt");
-    fs.cd("user");
-    fs.mkdir("Documents");
-    fs.mkdir("Downloads");
-    fs.touch("profile.txt");
-    fs.cd("Documents");
-    fs.touch("report.docx");
-    fs.cd("/"); // Go back to root
-
-    std::cout << "Welcome to the C++ File System Navigator!" << std::endl;
-    show_help();    while (true) {
-        std::cout << "fs" << fs.getPath(fs.getCurrentDirectory()) << "> ";
-        std::cout.flush(); // Ensure prompt is displayed immediately
-        
+    std::string journalDirectory;
+    std::string scriptFile;
+    std::string socketPath;
+    size_t workerCount = std::max(1u, std::thread::hardware_concurrency());
+    bool batch = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--journal" && i + 1 < argc) {
+            journalDirectory = argv[++i];
+        } else if (option == "--batch") {
+            batch = true;
+        } else if (option == "-f" && i + 1 < argc) {
+            scriptFile = argv[++i];
+            batch = true;
+        } else if (option == "--serve" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (option == "--workers" && i + 1 < argc && parse_count(argv[i + 1], workerCount)) {
+            ++i;
+        } else {
+            std::cout << "Usage: " << argv[0]
+                      << " [--journal <directory>] [--batch | -f <script> | --serve <socket> [--workers <n>]]" << '\n';
+            return 1;
+        }
+    }
+
+    // Batch mode prints no prompts or banners and never flushes on its own,
+    // so detach the C++ streams from stdio to let them buffer freely
+    if (batch) {
+        std::ios::sync_with_stdio(false);
+    }
+
+    // Pick up where the last journaled session left off, if there was one
+    bool restored = !journalDirectory.empty() && fs.openJournal(journalDirectory);
+    if (!restored) {
+        // Create a sample directory structure for demonstration
+        fs.mkdir(session, "home");
+        fs.cd(session, "home");
+        fs.mkdir(session, "user");
+        fs.touch(session, "readme.txt");
+        fs.cd(session, "user");
+        fs.mkdir(session, "Documents");
+        fs.mkdir(session, "Downloads");
+        fs.touch(session, "profile.txt");
+        fs.cd(session, "Documents");
+        fs.touch(session, "report.docx");
+        fs.cd(session, "/"); // Go back to root
+    }
+
+    if (!socketPath.empty()) {
+#ifdef __linux__
+        CommandServer server(fs);
+        return server.run(socketPath, workerCount) ? 0 : 1;
+#else
+        std::cout << "Error: --serve is only supported on Linux." << '\n';
+        return 1;
+#endif
+    }
+
+    if (!scriptFile.empty()) {
+        // Run the script straight out of the mapped file, one line at a time
+        MappedFile script(scriptFile);
+        if (!script.isOpen()) {
+            std::cout << "Error: Cannot open script '" << scriptFile << "'." << '\n';
+            return 1;
+        }
+        std::string_view remaining(script.getData(), script.size());
+        while (!remaining.empty()) {
+            size_t end = std::min(remaining.find('\n'), remaining.size());
+            std::string_view scriptLine = remaining.substr(0, end);
+            remaining.remove_prefix(std::min(end + 1, remaining.size()));
+            if (!run_command(fs, session, scriptLine)) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    if (batch) {
+        while (std::getline(std::cin, line) && run_command(fs, session, line)) {
+        }
+        return 0;
+    }
+
+    std::cout << "Welcome to the C++ File System Navigator!" << '\n';
+    show_help(std::cout);
+
+    while (true) {
+        if (fs.hasUncommittedChanges() && input_idle()) {
+            fs.commitJournal();
+        }
+        std::cout << "fs" << fs.getCurrentPath(session) << "> ";
+        std::cout.flush(); // Ensure prompt and earlier output are displayed immediately
+
         if (!std::getline(std::cin, line)) {
             // EOF reached (e.g., when using echo | program) or input error
-            std::cout << std::endl; // Print newline for clean exit
+            std::cout << '\n'; // Print newline for clean exit
             break;
         }
-        
-        // Skip empty lines
-        if (line.empty()) {
-            continue;
+        if (!run_command(fs, session, line)) {
+            break;
         }
-        
-        std::stringstream ss(line);
-        ss >> command >> argument;
+    }
 
-        if (command == "exit") {
-            break;
-        } else if (command == "pwd") {
-            fs.pwd();
-        } else if (command == "ls") {
-            fs.ls();
-        } else if (command == "mkdir") {
-            if (argument.empty()) std::cout << "Usage: mkdir <name>" << std::endl;
-            else fs.mkdir(argument);
-        } else if (command == "touch") {
-            if (argument.empty()) std::cout << "Usage: touch <name>" << std::endl;
-            else fs.touch(argument);
-        } else if (command == "cd") {
-            if (argument.empty()) std::cout << "Usage: cd <path>" << std::endl;
-            else fs.cd(argument);
-        } else if (command == "find") {
-            if (argument.empty()) std::cout << "Usage: find <name>" << std::endl;
-            else fs.find(argument);
-        } else if (command == "help") {
-            show_help();
-        } else if (!command.empty()) {
-            std::cout << "Unknown command: '" << command << "'. Type 'help' for a list of commands." << std::endl;
-        }
-        
-        command.clear();
-        argument.clear();
-    }
-
-    std::cout << "Exiting File System Navigator." << std::endl;
+    std::cout << "Exiting File System Navigator." << '\n';
     return 0;
-}
\ No newline at end of file
+}
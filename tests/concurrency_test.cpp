@@ -0,0 +1,188 @@
+// concurrency_test.cpp - sessions racing each other on one FileSystem
+//
+// Each test drives a FileSystem from several threads, every thread with its
+// own Session, then checks the tree that is left. Meant to be run under
+// AddressSanitizer and ThreadSanitizer; tests/run_tests.sh builds and runs
+// it both ways.
+//
+// Usage: ./concurrency_test <scratch-directory>
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <random>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << '\n';
+        ++failures;
+    }
+}
+
+// Every node of a tree as one sorted list of NDJSON lines, so that trees
+// built in different orders compare equal
+std::vector<std::string> listing(FileSystem& fs, const std::string& file) {
+    std::ostringstream discard;
+    Session session(discard);
+    fs.exportTree(session, file, false);
+    std::ifstream in(file);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);) {
+        lines.push_back(line);
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+// One session keeps creating directories, which now and then folds the
+// journal into a snapshot, while another loads a snapshot over the tree the
+// moment such a compaction starts writing. Afterwards the data directory
+// must restore exactly the live tree.
+void testCompactionDuringLoad(const std::string& scratch) {
+    std::string data = scratch + "/compaction";
+    std::string snapshot = scratch + "/compaction.snap";
+    std::filesystem::remove_all(data);
+    std::ostringstream discard;
+
+    FileSystem fs;
+    fs.openJournal(data);
+    {
+        Session session(discard);
+        fs.save(session, snapshot);
+    }
+    std::atomic<bool> stop{false};
+    std::atomic<int> loads{0};
+    std::thread loader([&] {
+        std::ostringstream output;
+        Session session(output);
+        std::string compacting = data + "/snapshot.bin.tmp";
+        while (!stop.load()) {
+            std::error_code error;
+            if (std::filesystem::exists(compacting, error)) {
+                fs.load(session, snapshot);
+                ++loads;
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    });
+    {
+        // Enough records for a few compactions
+        std::ostringstream output;
+        Session session(output);
+        for (int i = 0; i < 450000; ++i) {
+            fs.mkdir(session, "n" + std::to_string(i));
+        }
+    }
+    stop = true;
+    loader.join();
+    fs.commitJournal();
+    std::vector<std::string> live = listing(fs, scratch + "/live.ndjson");
+    check(loads.load() > 0, "compaction during load: a load overlapped a compaction");
+    check(live.size() > 1, "compaction during load: directories were created after the last load");
+
+    FileSystem restored;
+    restored.openJournal(data);
+    check(live == listing(restored, scratch + "/restored.ndjson"),
+          "compaction during load: the data directory restores the live tree");
+}
+
+// Several sessions create, list, search and remove directories while
+// another keeps loading a snapshot over the tree under them. Each writer
+// must always see a consistent working directory: its new directory, or
+// the root if a load moved it there. Afterwards the tree must survive a
+// save and load unchanged.
+void testMutationsDuringLoad(const std::string& scratch) {
+    std::string snapshot = scratch + "/mixed.snap";
+    const int writers = 3;
+    std::ostringstream discard;
+    FileSystem fs;
+    {
+        Session session(discard);
+        for (int t = 0; t < writers; ++t) {
+            fs.mkdir(session, "w" + std::to_string(t));
+        }
+        fs.save(session, snapshot);
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> loads{0};
+    std::thread loader([&] {
+        std::ostringstream output;
+        Session session(output);
+        while (!stop.load()) {
+            fs.load(session, snapshot);
+            ++loads;
+            output.str("");
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    });
+    std::vector<std::thread> pool;
+    std::atomic<int> lost{0};
+    for (int t = 0; t < writers; ++t) {
+        pool.emplace_back([&, t] {
+            std::ostringstream output;
+            Session session(output);
+            std::mt19937 rng(t);
+            for (int i = 0; i < 3000; ++i) {
+                std::string name = "t" + std::to_string(t) + "_" + std::to_string(i);
+                fs.cd(session, "/w" + std::to_string(t));
+                fs.mkdir(session, name);
+                fs.cd(session, name);
+                fs.touch(session, "x");
+                output.str("");
+                fs.pwd(session);
+                std::string path = output.str();
+                std::string tail = "/" + name + "\n";
+                bool inDirectory = path.size() >= tail.size() &&
+                                   path.compare(path.size() - tail.size(), tail.size(), tail) == 0;
+                if (path != "/\n" && !inDirectory) {
+                    ++lost;
+                }
+                fs.cd(session, "..");
+                fs.ls(session);
+                if (rng() % 8 == 0) {
+                    fs.find(session, "x");
+                }
+                if (rng() % 2 == 0) {
+                    fs.rm(session, name, true);
+                }
+                output.str("");
+            }
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    stop = true;
+    loader.join();
+    check(loads.load() > 0, "mutations during load: loads ran alongside the writers");
+    check(lost.load() == 0, "mutations during load: pwd always names the session's directory or the root");
+
+    std::vector<std::string> live = listing(fs, scratch + "/mixed-live.ndjson");
+    Session session(discard);
+    fs.save(session, snapshot);
+    fs.load(session, snapshot);
+    check(live == listing(fs, scratch + "/mixed-reloaded.ndjson"),
+          "mutations during load: the final tree survives save and load");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cout << "Usage: " << argv[0] << " <scratch-directory>" << '\n';
+        return 1;
+    }
+    std::string scratch = argv[1];
+    std::filesystem::create_directories(scratch);
+    testCompactionDuringLoad(scratch);
+    testMutationsDuringLoad(scratch);
+    std::cout << (failures == 0 ? "All concurrency tests passed." : "Some concurrency tests failed.") << '\n';
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+// import_test.cpp - import of a small host directory tree
+//
+// Builds a host tree in the scratch directory with one name that clashes
+// with an existing node of the other kind and one directory that cannot be
+// read, imports it with one and with several threads, and checks the nodes
+// that arrive and the counts import reports. tests/run_tests.sh builds and
+// runs it under AddressSanitizer.
+//
+// Usage: ./import_test <scratch-directory>
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << '\n';
+        ++failures;
+    }
+}
+
+void makeFile(const std::string& path) { close(open(path.c_str(), O_CREAT | O_WRONLY, 0644)); }
+
+bool readable(const std::string& directory) {
+    int descriptor = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (descriptor < 0) {
+        return false;
+    }
+    close(descriptor);
+    return true;
+}
+
+// The paths below /dst that find reports, sorted
+std::vector<std::string> imported(FileSystem& fs) {
+    std::ostringstream out;
+    Session session(out);
+    fs.find(session, "*", FindMode::GLOB);
+    std::istringstream lines(out.str());
+    std::vector<std::string> paths;
+    for (std::string path; std::getline(lines, path);) {
+        if (path.rfind("/dst/", 0) == 0) {
+            paths.push_back(path);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Imports 'host' into /dst, which already holds a directory named 'clash'
+// and a directory 'a' with a file 'old', and returns what import printed
+std::string importInto(FileSystem& fs, const std::string& host, size_t threads) {
+    std::ostringstream out;
+    Session session(out);
+    fs.mkdir(session, "dst");
+    fs.cd(session, "dst");
+    fs.mkdir(session, "clash");
+    fs.mkdir(session, "a");
+    fs.cd(session, "a");
+    fs.touch(session, "old");
+    fs.cd(session, "/");
+    out.str("");
+    fs.import(session, host, "/dst", threads);
+    return out.str();
+}
+
+void testImport(const std::string& scratch) {
+    // host/a/x, host/a/deep/z, host/clash (a file), host/top and host/locked,
+    // a directory nobody may read
+    std::string host = scratch + "/host";
+    std::filesystem::remove_all(host);
+    std::filesystem::create_directories(host + "/a/deep");
+    std::filesystem::create_directories(host + "/locked");
+    makeFile(host + "/a/x");
+    makeFile(host + "/a/deep/z");
+    makeFile(host + "/clash");
+    makeFile(host + "/top");
+    makeFile(host + "/locked/hidden");
+    chmod((host + "/locked").c_str(), 0);
+
+    // Root reads every directory, so import as nobody while running as root,
+    // unless nobody cannot reach the scratch directory at all
+    bool asNobody = geteuid() == 0 && seteuid(65534) == 0;
+    if (asNobody && !readable(host)) {
+        asNobody = seteuid(0) != 0;
+    }
+    bool lockedOut = !readable(host + "/locked");
+
+    const std::vector<std::string> expected = {"/dst/a",    "/dst/a/deep", "/dst/a/deep/z", "/dst/a/old",
+                                               "/dst/a/x",  "/dst/clash",  "/dst/locked",   "/dst/top"};
+    for (size_t threads : {size_t(1), size_t(4)}) {
+        std::string what = "import -j " + std::to_string(threads) + ": ";
+        FileSystem fs;
+        std::string output = importInto(fs, host, threads);
+        // locked/hidden comes in too when the directory can be read after all
+        std::string counts = lockedOut ? "5 entries from '" + host + "' (2 directories, 3 files)"
+                                       : "6 entries from '" + host + "' (2 directories, 4 files)";
+        check(output.find("Imported " + counts + ".\n") == 0, what + "reports the new directories and files");
+        check(output.find("Warning: 1 entries clashed with existing names and were skipped.\n") != std::string::npos,
+              what + "reports the clash");
+        check(output.find("were dropped") == std::string::npos, what + "drops no entries");
+        if (lockedOut) {
+            check(output.find("Warning: 1 directories could not be read.\n") != std::string::npos,
+                  what + "reports the unreadable directory");
+            check(imported(fs) == expected, what + "imports every readable entry and merges into /dst/a");
+        }
+
+        // Everything is there already, so a second import adds nothing
+        std::ostringstream again;
+        Session session(again);
+        fs.import(session, host, "/dst", threads);
+        check(again.str().find("Imported 0 entries") == 0, what + "a repeated import adds nothing");
+        if (lockedOut) {
+            check(imported(fs) == expected, what + "a repeated import leaves the tree alone");
+        }
+    }
+    if (!lockedOut) {
+        std::cout << "Skipped the unreadable directory checks: cannot drop read access here." << '\n';
+    }
+    if (asNobody) {
+        if (seteuid(0) != 0) {
+            std::cout << "Warning: Cannot switch back to root." << '\n';
+        }
+    }
+    chmod((host + "/locked").c_str(), 0755);
+    std::filesystem::remove_all(host);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cout << "Usage: " << argv[0] << " <scratch-directory>" << '\n';
+        return 1;
+    }
+    std::string scratch = argv[1];
+    std::filesystem::create_directories(scratch);
+    testImport(scratch);
+    std::cout << (failures == 0 ? "All import tests passed." : "Some import tests failed.") << '\n';
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+// kernels_test.cpp - the name search kernels against a plain reference
+//
+// Fills a NameTable with random names over a small alphabet, so that
+// needles match often and near misses abound, then runs the searches at
+// every kernel level the CPU supports. findWithPrefix, findWithSuffix and
+// findContaining must return exactly the names a plain string comparison
+// picks. Names and needles run from one character to longer than an AVX2
+// vector. Meant to be run under AddressSanitizer, which also catches
+// kernels reading past the padding; tests/run_tests.sh builds it that way.
+//
+// Usage: ./kernels_test
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <random>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << '\n';
+        ++failures;
+    }
+}
+
+std::string randomText(std::mt19937& rng, size_t length) {
+    static const char ALPHABET[] = "ab.x";
+    std::string text;
+    for (size_t i = 0; i < length; ++i) {
+        text += ALPHABET[rng() % 4];
+    }
+    return text;
+}
+
+// The ids of all names for which 'matches' holds, in id order
+template <typename F>
+std::vector<NameId> reference(const NameTable& table, F matches) {
+    std::vector<NameId> ids;
+    for (NameId id = 0; id < table.size(); ++id) {
+        if (matches(table.get(id))) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+
+std::vector<NameId> sorted(std::vector<NameId> ids) {
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+void testLevel(const NameTable& table, NameKernels::Level level, std::mt19937& rng) {
+    NameKernels::currentLevel() = level;
+    std::string name = NameKernels::levelName(level);
+    for (size_t length = 0; length <= 40; ++length) {
+        for (int i = 0; i < 8; ++i) {
+            // Half the needles are cut out of a name, so that they hit
+            std::string needle = randomText(rng, length);
+            if (i % 2 == 0) {
+                std::string_view source = table.get(static_cast<NameId>(rng() % table.size()));
+                if (source.size() >= length) {
+                    needle = std::string(source.substr(rng() % (source.size() - length + 1), length));
+                }
+            }
+            std::string what = name + " kernels, needle '" + needle + "': ";
+            std::vector<NameId> ids;
+            table.findWithPrefix(needle, ids);
+            check(sorted(ids) == reference(table, [&](std::string_view text) {
+                      return text.substr(0, needle.size()) == needle;
+                  }),
+                  what + "prefix");
+            ids.clear();
+            table.findWithSuffix(needle, ids);
+            check(sorted(ids) == reference(table, [&](std::string_view text) {
+                      return text.size() >= needle.size() && text.substr(text.size() - needle.size()) == needle;
+                  }),
+                  what + "suffix");
+            ids.clear();
+            table.findContaining(needle, ids);
+            check(sorted(ids) == reference(table, [&](std::string_view text) {
+                      return text.find(needle) != std::string_view::npos;
+                  }),
+                  what + "contains");
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(11);
+    Reclaimer reclaimer;
+    NameTable table;
+    for (int i = 0; i < 5000; ++i) {
+        table.intern(randomText(rng, 1 + rng() % 40), reclaimer);
+    }
+    NameKernels::Level best = NameKernels::detectLevel();
+    for (auto level : {NameKernels::Level::SCALAR, NameKernels::Level::SSE2, NameKernels::Level::AVX2}) {
+        if (level <= best) {
+            testLevel(table, level, rng);
+        } else {
+            std::cout << "Skipped the " << NameKernels::levelName(level) << " kernels, which this CPU or build lacks."
+                      << '\n';
+        }
+    }
+    std::cout << (failures == 0 ? "All kernel tests passed." : "Some kernel tests failed.") << '\n';
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+// persistence_test.cpp - what the tree looks like after it is stored or relaid
+//
+// Builds a tree through the commands, then checks that save/load, compact
+// and freeze leave every command's output unchanged, and that a journal
+// whose last record was cut short replays everything before it.
+// tests/run_tests.sh builds and runs it under AddressSanitizer.
+//
+// Usage: ./persistence_test <scratch-directory>
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#include <random>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << '\n';
+        ++failures;
+    }
+}
+
+// What a user can see of the tree: every path find reports, and for each of
+// them what cd, ls and pwd print there. Works on frozen trees too.
+std::string describe(FileSystem& fs) {
+    std::ostringstream paths;
+    {
+        Session session(paths);
+        fs.find(session, "*", FindMode::GLOB);
+    }
+    std::ostringstream out;
+    Session session(out);
+    out << paths.str();
+    std::istringstream lines(paths.str());
+    for (std::string path; std::getline(lines, path);) {
+        fs.cd(session, path);
+        fs.ls(session);
+        fs.pwd(session);
+    }
+    return out.str();
+}
+
+// A few thousand directories and files, with every fourth file and some
+// whole subtrees removed again
+void buildTree(FileSystem& fs) {
+    std::ostringstream discard;
+    Session session(discard);
+    std::mt19937 rng(5);
+    std::vector<std::string> directories{"/"};
+    for (int i = 0; i < 3000; ++i) {
+        const std::string& parent = directories[rng() % directories.size()];
+        fs.cd(session, parent);
+        std::string name = "n" + std::to_string(rng() % 500);
+        if (rng() % 3 == 0) {
+            fs.mkdir(session, name);
+            directories.push_back((parent == "/" ? parent : parent + "/") + name);
+        } else {
+            fs.touch(session, name + ".txt");
+            if (i % 4 == 0) {
+                fs.rm(session, name + ".txt", false);
+            }
+        }
+        if (i % 500 == 499) {
+            fs.cd(session, directories[1 + rng() % (directories.size() - 1)]);
+            fs.cd(session, "..");
+            fs.rm(session, directories.back().substr(directories.back().rfind('/') + 1), true);
+        }
+    }
+}
+
+void testSaveAndLoad(const std::string& scratch) {
+    std::string snapshot = scratch + "/tree.bin";
+    std::ostringstream discard;
+    Session session(discard);
+    FileSystem fs;
+    buildTree(fs);
+    std::string before = describe(fs);
+    fs.save(session, snapshot);
+
+    FileSystem loaded;
+    loaded.load(session, snapshot);
+    check(describe(loaded) == before, "save/load: a loaded snapshot looks like the saved tree");
+
+    fs.cd(session, "/");
+    fs.mkdir(session, "changed");
+    fs.load(session, snapshot);
+    check(describe(fs) == before, "save/load: loading over a changed tree restores the saved one");
+}
+
+void testCompact() {
+    std::ostringstream discard;
+    Session session(discard);
+    FileSystem fs;
+    buildTree(fs);
+    std::string before = describe(fs);
+    fs.compact(session);
+    check(describe(fs) == before, "compact: the relaid tree looks the same");
+}
+
+void testFreeze() {
+    std::ostringstream output;
+    Session session(output);
+    FileSystem fs;
+    buildTree(fs);
+    std::string before = describe(fs);
+    fs.freeze(session);
+    check(describe(fs) == before, "freeze: the frozen tree looks the same");
+
+    output.str("");
+    fs.mkdir(session, "refused");
+    check(output.str().rfind("Error:", 0) == 0, "freeze: mkdir is refused");
+    check(describe(fs) == before, "freeze: a refused mkdir changes nothing");
+}
+
+// Cuts the last journal record short, as a crash in the middle of writing
+// it would, and checks that replay keeps everything before it and that the
+// journal is usable afterwards
+void testTornJournal(const std::string& scratch) {
+    std::string data = scratch + "/journal";
+    std::filesystem::remove_all(data);
+    std::ostringstream discard;
+    std::string expected;
+    {
+        FileSystem fs;
+        Session session(discard);
+        fs.openJournal(data);
+        fs.mkdir(session, "kept");
+        fs.cd(session, "kept");
+        for (int i = 0; i < 100; ++i) {
+            fs.touch(session, "f" + std::to_string(i));
+        }
+        fs.rm(session, "f7", false);
+        fs.commitJournal();
+        expected = describe(fs);
+        fs.cd(session, "/kept");
+        fs.mkdir(session, "torn");
+        fs.commitJournal();
+    }
+    std::string journal = data + "/journal.log";
+    std::filesystem::resize_file(journal, std::filesystem::file_size(journal) - 3);
+    {
+        FileSystem fs;
+        Session session(discard);
+        check(fs.openJournal(data), "torn journal: the data directory is restored");
+        check(describe(fs) == expected, "torn journal: every record before the torn one is replayed");
+        fs.cd(session, "/kept");
+        fs.mkdir(session, "after");
+        fs.commitJournal();
+        expected = describe(fs);
+    }
+    {
+        FileSystem fs;
+        fs.openJournal(data);
+        check(describe(fs) == expected, "torn journal: records written after recovery are replayed");
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cout << "Usage: " << argv[0] << " <scratch-directory>" << '\n';
+        return 1;
+    }
+    std::string scratch = argv[1];
+    std::filesystem::create_directories(scratch);
+    testSaveAndLoad(scratch);
+    testTornJournal(scratch);
+    testCompact();
+    testFreeze();
+    std::cout << (failures == 0 ? "All persistence tests passed." : "Some persistence tests failed.") << '\n';
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+// server_test.cpp - pipelined clients of the --serve command server
+//
+// Starts a CommandServer with four workers on a socket in the scratch
+// directory, in a child process, and sends it one long pipeline: writes
+// that fill a directory, then rounds of read-only commands (ls, pwd and
+// find), each round more than 2 * PARALLEL_GROUP lines long and ended by a
+// write. The answers run to several megabytes, so the server has to
+// stop reading while they back up and resume the waiting lines later. They
+// must arrive framed, in order, and equal to running the same lines one by
+// one on a tree of our own.
+//
+// This runs twice: with the server believing it has one CPU, so reads run
+// one by one, and with it believing it has four, so each round of reads is
+// shared out as a ReadGroup. tests/run_tests.sh builds and runs it under
+// AddressSanitizer.
+//
+// Usage: ./server_test <scratch-directory>
+
+#define main navigator_main
+#include "../navigator.cpp"
+#undef main
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/wait.h>
+#endif
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << '\n';
+        ++failures;
+    }
+}
+
+#ifdef __linux__
+std::vector<std::string> pipeline() {
+    std::vector<std::string> lines = {"mkdir d", "cd d"};
+    for (int i = 0; i < 3000; ++i) {
+        lines.push_back("touch file_" + std::to_string(i));
+    }
+    lines.push_back("cd /");
+    const char* const reads[] = {"find -name *", "ls", "pwd", "find file_7", "find -name file_1*"};
+    for (int round = 0; round < 12; ++round) {
+        for (int i = 0; i < 40; ++i) {
+            lines.push_back(reads[i % 5]);
+        }
+        lines.push_back("mkdir r" + std::to_string(round));
+    }
+    lines.push_back("exit");
+    return lines;
+}
+
+// The answers to 'lines' run one by one on a fresh tree
+std::vector<std::string> sequential(const std::vector<std::string>& lines) {
+    FileSystem fs;
+    std::ostringstream out;
+    Session session(out);
+    std::vector<std::string> answers;
+    for (const auto& line : lines) {
+        out.str("");
+        run_command(fs, session, line);
+        answers.push_back(out.str());
+    }
+    return answers;
+}
+
+int connectTo(const std::string& socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    // The server may still be starting up
+    for (int attempt = 0; attempt < 500; ++attempt) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            return fd;
+        }
+        ::close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// Splits a stream of answers into their bodies; false if a frame is broken
+bool unframe(const std::string& data, std::vector<std::string>& answers) {
+    size_t position = 0;
+    while (position < data.size()) {
+        size_t end = data.find('\n', position);
+        if (end == std::string::npos || end == position) {
+            return false;
+        }
+        size_t length = 0;
+        auto parsed = std::from_chars(data.data() + position, data.data() + end, length);
+        if (parsed.ptr != data.data() + end || end + 1 + length > data.size()) {
+            return false;
+        }
+        answers.push_back(data.substr(end + 1, length));
+        position = end + 1 + length;
+    }
+    return true;
+}
+
+void testPipeline(const std::string& scratch, size_t cpuCount) {
+    std::string what = std::to_string(cpuCount) + (cpuCount == 1 ? " CPU: " : " CPUs: ");
+    std::string socketPath = scratch + "/server.sock";
+    std::cout.flush();
+    pid_t child = ::fork();
+    if (child == 0) {
+        int null = ::open("/dev/null", O_WRONLY);
+        ::dup2(null, STDOUT_FILENO);
+        FileSystem fs;
+        CommandServer server(fs, cpuCount);
+        _exit(server.run(socketPath, 4) ? 0 : 1);
+    }
+    int fd = connectTo(socketPath);
+    check(fd >= 0, what + "the server accepts a connection");
+    if (fd < 0) {
+        ::kill(child, SIGKILL);
+        ::waitpid(child, nullptr, 0);
+        return;
+    }
+
+    // Send everything at once from another thread while answers come back;
+    // the server stops reading whenever they back up
+    std::vector<std::string> lines = pipeline();
+    std::string request;
+    for (const auto& line : lines) {
+        request += line + '\n';
+    }
+    std::thread sender([&] {
+        size_t sent = 0;
+        while (sent < request.size()) {
+            ssize_t count = ::send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (count <= 0) {
+                return;
+            }
+            sent += static_cast<size_t>(count);
+        }
+    });
+    std::string data;
+    char buffer[1 << 16];
+    for (ssize_t count; (count = ::recv(fd, buffer, sizeof(buffer), 0)) > 0;) {
+        data.append(buffer, static_cast<size_t>(count));
+    }
+    sender.join();
+    ::close(fd);
+    ::kill(child, SIGTERM);
+    int status = 0;
+    ::waitpid(child, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0, what + "the server stops cleanly");
+
+    std::vector<std::string> answers;
+    check(unframe(data, answers), what + "every answer is framed by its length");
+    // Twice the unsent output at which the server stops running lines
+    check(data.size() > (2 << 20), what + "the answers are large enough to back up");
+    std::vector<std::string> expected = sequential(lines);
+    check(answers.size() == expected.size(), what + "one answer per line, 'exit' included");
+    for (size_t i = 0; i < std::min(answers.size(), expected.size()); ++i) {
+        if (answers[i] != expected[i]) {
+            check(false, what + "answer " + std::to_string(i) + " ('" + lines[i] + "') matches a sequential run");
+            break;
+        }
+    }
+}
+#endif
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cout << "Usage: " << argv[0] << " <scratch-directory>" << '\n';
+        return 1;
+    }
+    std::string scratch = argv[1];
+    std::filesystem::create_directories(scratch);
+#ifdef __linux__
+    testPipeline(scratch, 1);
+    testPipeline(scratch, 4);
+    std::cout << (failures == 0 ? "All server tests passed." : "Some server tests failed.") << '\n';
+#else
+    std::cout << "Skipped the server tests: --serve is only supported on Linux." << '\n';
+#endif
+    return failures == 0 ? 0 : 1;
+}